@@ -0,0 +1,392 @@
+#!/usr/bin/env python3
+"""
+Benchmarks for tg. Generates synthetic workloads into the work directory, runs them with the given tg executable and
+reports wall time, peak resident set size and allocations of each workload. Allocations are the strings, arrays and
+patterns tg reports with --stats.
+
+Results can be saved as a baseline and later runs compared against it, to catch performance regressions:
+    python3 bench/bench.py build/release/tg.out --save-baseline
+    python3 bench/bench.py build/release/tg.out
+The exit code is 1 if a workload failed or regressed compared to the baseline.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+try:
+    import resource
+except ImportError:
+    resource = None  # Peak RSS is only reported on platforms that have wait4.
+
+
+def scaled(count, scale):
+    return max(1, int(count * scale))
+
+
+def write_recursion(path, scale):
+    depth = scaled(2000, scale)
+    with open(path, "w") as f:
+        f.write("generator down(n: int) {\n"
+                "    $if (n > 0) {\n"
+                "        ${n}\n"
+                "        $down(n - 1);\n"
+                "    }\n"
+                "}\n"
+                "generator main() {\n"
+                "    $for (i in range(0, %d)) {\n"
+                "        $down(%d);\n"
+                "    }\n"
+                "}\n"
+                "main();\n" % (scaled(100, scale), depth))
+
+
+def write_range_loop(path, scale):
+    with open(path, "w") as f:
+        f.write("generator main() {\n"
+                "    $n := 0;\n"
+                "    $for (i in range(0, %d)) {\n"
+                "        $n = n + i %% 7;\n"
+                "        $if (i %% 3 == 0) {\n"
+                "            ${i} ${n}\n"
+                "        }\n"
+                "    }\n"
+                "}\n"
+                "main();\n" % scaled(1000000, scale))
+
+
+def write_enums_json(path, scale):
+    # Roughly 50MB of JSON at scale 1.
+    json_path = os.path.splitext(path)[0] + ".json"
+    with open(json_path, "w") as f:
+        f.write('{"enums": [\n')
+        for i in range(scaled(30000, scale)):
+            if i:
+                f.write(",\n")
+            values = ", ".join('"VALUE_%d_%d"' % (i, j) for j in range(100))
+            f.write('{"name": "generated_enum_%d", "values": [%s]}' % (i, values))
+        f.write("\n]}\n")
+    return json_path
+
+
+def write_json_enums(path, scale):
+    json_path = write_enums_json(path, scale)
+    with open(path, "w") as f:
+        f.write("generator enums(path: string) {\n"
+                "    $doc := read_json_document(path);\n"
+                "    $for (e in doc.root[\"enums\"]) {\n"
+                "        enum ${e[\"name\"].to_string()} {\n"
+                "            $for (v in e[\"values\"]) {\n"
+                "                ${v.to_string()}${,}\n"
+                "            }\n"
+                "        };\n"
+                "    }\n"
+                "}\n"
+                "enums(argv[1]);\n")
+    return [json_path]
+
+
+def write_json_lazy(path, scale):
+    # Reads every hundredth enum of a large document, the rest is only skipped over.
+    json_path = write_enums_json(path, scale)
+    with open(path, "w") as f:
+        f.write("generator enums(path: string) {\n"
+                "    $doc := read_json_document_lazy(path);\n"
+                "    $enums := doc.root[\"enums\"];\n"
+                "    $for (i in range(0, enums.size / 100)) {\n"
+                "        $e := enums[i * 100];\n"
+                "        enum ${e[\"name\"].to_string()} {\n"
+                "            $for (v in e[\"values\"]) {\n"
+                "                ${v.to_string()}${,}\n"
+                "            }\n"
+                "        };\n"
+                "    }\n"
+                "}\n"
+                "enums(argv[1]);\n")
+    return [json_path]
+
+
+def write_json_find(path, scale):
+    # Every entry refers to another entry by name, resolved with find_object.
+    count = scaled(20000, scale)
+    json_path = os.path.splitext(path)[0] + ".json"
+    with open(json_path, "w") as f:
+        entries = ('{"id": %d, "name": "type_%d", "base": "type_%d"}' % (i, i, (i * 7) % count) for i in range(count))
+        f.write('{"types": [\n%s\n]}\n' % ",\n".join(entries))
+    with open(path, "w") as f:
+        f.write("generator types(path: string) {\n"
+                "    $doc := read_json_document(path);\n"
+                "    $types := doc.root[\"types\"];\n"
+                "    $for (t in types) {\n"
+                "        $base := types.find_object(\"name\", t[\"base\"].to_string());\n"
+                "        struct ${t[\"name\"].to_string()} : ${base[\"name\"].to_string()} {}; // ${base[\"id\"]}\n"
+                "    }\n"
+                "}\n"
+                "types(argv[1]);\n")
+    return [json_path]
+
+
+def write_json_lines(path, scale):
+    # One record per line, read with constant memory however large the file is.
+    json_path = os.path.splitext(path)[0] + ".jsonl"
+    with open(json_path, "w") as f:
+        for i in range(scaled(500000, scale)):
+            f.write('{"name": "event_%d", "id": %d, "fields": ["field_%d", "time", "source"]}\n' % (i, i, i))
+    with open(path, "w") as f:
+        f.write("generator events(path: string) {\n"
+                "    $for (e in read_json_lines(path)) {\n"
+                "        struct ${e[\"name\"].to_string()} {\n"
+                "            static const int id = ${e[\"id\"]};\n"
+                "            $for (f in e[\"fields\"]) {\n"
+                "                int ${f.to_string()};\n"
+                "            }\n"
+                "        };\n"
+                "    }\n"
+                "}\n"
+                "events(argv[1]);\n")
+    return [json_path]
+
+
+def write_csv(path, scale):
+    # Roughly 100MB of CSV at scale 1, most of the fields are never read.
+    csv_path = os.path.splitext(path)[0] + ".csv"
+    with open(csv_path, "w") as f:
+        f.write("name,address,access,reset,description\n")
+        for i in range(scaled(1500000, scale)):
+            f.write('REG_%d,0x%08x,rw,0x0,"Register %d, see the ""%d"" section of the manual"\n' % (i, i * 4, i, i))
+    with open(path, "w") as f:
+        f.write("generator registers(path: string) {\n"
+                "    $table := read_csv(path);\n"
+                "    $for (r in table) {\n"
+                "        #define ${r[\"name\"]} ${r[\"address\"]}\n"
+                "    }\n"
+                "}\n"
+                "registers(argv[1]);\n")
+    return [csv_path]
+
+
+def write_patterns(path, scale):
+    types = ["int", "float", "std::string", "bool", "unsigned"]
+    lines = ['"%s field_%d"' % (types[i % len(types)], i) for i in range(scaled(50000, scale))]
+    with open(path, "w") as f:
+        f.write("pattern member: {type} {name};\n"
+                "generator fields(members: member[]) {\n"
+                "    $for (m in members) {\n"
+                "        ${m.type} m_${m.name};\n"
+                "    }\n"
+                "}\n")
+        # Strings are matched against the pattern on every call.
+        f.write("lines := [%s];\n" % ",\n".join(lines))
+        f.write("fields(lines);\n" * 10)
+
+
+def write_pattern_sums(path, scale):
+    lines = []
+    for i in range(scaled(20000, scale)):
+        kind = i % 5
+        if kind == 0:
+            lines.append('"enum E%d = %d"' % (i, i))
+        elif kind == 1:
+            lines.append('"struct S%d"' % i)
+        elif kind == 2:
+            lines.append('"unsigned long long field_%d"' % i)
+        elif kind == 3:
+            lines.append('"typedef unsigned long long as u%d"' % i)
+        else:
+            lines.append('"int field_%d"' % i)
+    with open(path, "w") as f:
+        # The words of typedef_decl are followed by a raw word, so matching it has to backtrack.
+        f.write("pattern enum_decl: enum {name} = {value: int};\n"
+                "pattern struct_decl: struct {name};\n"
+                "pattern typedef_decl: typedef {type: word+} as {name};\n"
+                "pattern member: {type: word+} {name};\n"
+                "sum decl: enum_decl | struct_decl | typedef_decl | member;\n"
+                "generator decls(ds: decl[]) {\n"
+                "    $for (d in ds) {\n"
+                "        $if (d instanceof member) {\n"
+                "            ${d.type} m_${d.name};\n"
+                "        } else {\n"
+                "            // ${d}\n"
+                "        }\n"
+                "    }\n"
+                "}\n")
+        # Every string tries the entries of the sum, the member entry has a variable number of words.
+        f.write("lines := [%s];\n" % ",\n".join(lines))
+        f.write("decls(lines);\n" * 5)
+
+
+def write_literals(path, scale):
+    with open(path, "w") as f:
+        f.write("generator block(prefix: string) {\n")
+        for i in range(scaled(20000, scale)):
+            f.write("    static const char* ${prefix}_line_%d = \"literal text that is copied verbatim %d\";\n" %
+                    (i, i))
+        f.write("}\n")
+        for i in range(20):
+            f.write("block(\"p%d\");\n" % i)
+
+
+# Workload names and the functions that write their scripts. Functions return additional generated files, that are
+# passed to the script as arguments.
+WORKLOADS = [
+    ("recursion", write_recursion),
+    ("range_loop", write_range_loop),
+    ("json_enums", write_json_enums),
+    ("json_lazy", write_json_lazy),
+    ("json_find", write_json_find),
+    ("json_lines", write_json_lines),
+    ("csv", write_csv),
+    ("patterns", write_patterns),
+    ("pattern_sums", write_pattern_sums),
+    ("literals", write_literals),
+]
+
+
+def generate_workloads(work_dir, scale, names):
+    """Writes the workload scripts, unless they were already generated with the same scale by this version of the
+    driver."""
+    os.makedirs(work_dir, exist_ok=True)
+    stamp_path = os.path.join(work_dir, "workloads.json")
+    stamp = {}
+    if os.path.exists(stamp_path):
+        with open(stamp_path) as f:
+            stamp = json.load(f)
+
+    result = {}
+    for name, write in WORKLOADS:
+        if name not in names:
+            continue
+        script = os.path.join(work_dir, name + ".tg")
+        entry = stamp.get(name)
+        files = [script] + (entry["args"] if entry else [])
+        if (entry and entry["scale"] == scale and all(os.path.exists(p) for p in files) and
+                os.path.getmtime(script) >= os.path.getmtime(__file__)):
+            result[name] = (script, entry["args"])
+            continue
+        print("Generating %s." % script)
+        args = write(script, scale) or []
+        stamp[name] = {"scale": scale, "args": args}
+        result[name] = (script, args)
+
+    with open(stamp_path, "w") as f:
+        json.dump(stamp, f, indent=4)
+    return result
+
+
+ALLOCATIONS_RE = re.compile(r"Allocated (\d+) strings, arrays and patterns")
+
+
+def run_workload(tg, script, args, output):
+    """Runs tg once, returns (seconds, peak rss in KiB or None, allocations or None) or None on failure."""
+    command = [tg, script, "--stats", "--output", output, "--"] + args
+    # Console output goes to a log file instead of a pipe, so that tg can't block on a full pipe while it is waited on.
+    log_path = output + ".log"
+    with open(log_path, "w+b") as log:
+        start = time.perf_counter()
+        process = subprocess.Popen(command, stdout=log, stderr=subprocess.STDOUT)
+        rss_kb = None
+        if resource and hasattr(os, "wait4"):
+            _, status, usage = os.wait4(process.pid, 0)
+            elapsed = time.perf_counter() - start
+            # Popen doesn't know the process was already waited on.
+            process.returncode = os.waitstatus_to_exitcode(status)
+            # ru_maxrss is in bytes on macOS and in KiB elsewhere.
+            rss_kb = usage.ru_maxrss // 1024 if sys.platform == "darwin" else usage.ru_maxrss
+        else:
+            process.wait()
+            elapsed = time.perf_counter() - start
+        log.seek(0)
+        console = log.read().decode(errors="replace")
+
+    if process.returncode != 0:
+        sys.stderr.write(console)
+        return None
+    match = ALLOCATIONS_RE.search(console)
+    return elapsed, rss_kb, int(match.group(1)) if match else None
+
+
+def format_change(current, baseline):
+    if current is None or not baseline:
+        return ""
+    return "%+.1f%%" % ((current - baseline) * 100.0 / baseline)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs the tg benchmarks.")
+    parser.add_argument("tg", help="tg executable to benchmark, preferably a release build")
+    parser.add_argument("--work-dir", default=os.path.join("build", "bench"),
+                        help="directory for generated workloads and outputs (default: build/bench)")
+    parser.add_argument("--baseline", help="baseline file (default: baseline.json in the work directory)")
+    parser.add_argument("--save-baseline", action="store_true", help="save the results as the new baseline")
+    parser.add_argument("--scale", type=float, default=1.0, help="size of the generated workloads (default: 1.0)")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per workload, the fastest one counts")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percentage that time or peak rss may grow before it counts as a regression")
+    parser.add_argument("workloads", nargs="*", help="workloads to run (default: all)")
+    options = parser.parse_intermixed_args()
+
+    names = options.workloads or [name for name, _ in WORKLOADS]
+    unknown = [name for name in names if name not in dict(WORKLOADS)]
+    if unknown:
+        parser.error("unknown workloads: %s" % ", ".join(unknown))
+
+    baseline_path = options.baseline or os.path.join(options.work_dir, "baseline.json")
+    baseline = {}
+    if not options.save_baseline and os.path.exists(baseline_path):
+        with open(baseline_path) as f:
+            baseline = json.load(f)
+        if baseline.get("scale") != options.scale:
+            print("Baseline \"%s\" was saved with a different scale, not comparing." % baseline_path)
+            baseline = {}
+
+    workloads = generate_workloads(options.work_dir, options.scale, names)
+
+    print("%-12s %10s %10s %12s %14s" % ("Workload", "Time s", "Change", "Peak RSS KiB", "Allocations"))
+    results = {}
+    failed = False
+    regressions = []
+    for name in names:
+        script, args = workloads[name]
+        output = os.path.join(options.work_dir, name + ".out")
+        runs = [run_workload(options.tg, script, args, output) for _ in range(max(1, options.repeat))]
+        if any(run is None for run in runs):
+            print("%-12s failed" % name)
+            failed = True
+            continue
+
+        elapsed = min(run[0] for run in runs)
+        rss_kb = max(run[1] for run in runs) if runs[0][1] is not None else None
+        allocations = runs[0][2]
+        results[name] = {"time": elapsed, "rss_kb": rss_kb, "allocations": allocations}
+
+        base = baseline.get("workloads", {}).get(name, {})
+        print("%-12s %10.3f %10s %12s %14s" % (name, elapsed, format_change(elapsed, base.get("time")),
+                                               "-" if rss_kb is None else rss_kb,
+                                               "-" if allocations is None else allocations))
+        limit = 1.0 + options.threshold / 100.0
+        if base.get("time") and elapsed > base["time"] * limit:
+            regressions.append("%s: time %.3fs, baseline %.3fs" % (name, elapsed, base["time"]))
+        if rss_kb and base.get("rss_kb") and rss_kb > base["rss_kb"] * limit:
+            regressions.append("%s: peak rss %d KiB, baseline %d KiB" % (name, rss_kb, base["rss_kb"]))
+        # Allocation counts don't depend on the machine, any increase is a regression.
+        if allocations is not None and base.get("allocations") is not None and allocations > base["allocations"]:
+            regressions.append("%s: %d allocations, baseline %d" % (name, allocations, base["allocations"]))
+
+    if options.save_baseline:
+        with open(baseline_path, "w") as f:
+            json.dump({"scale": options.scale, "workloads": results}, f, indent=4)
+        print("Saved baseline \"%s\"." % baseline_path)
+
+    if regressions:
+        print("\nRegressions compared to \"%s\":" % baseline_path)
+        for regression in regressions:
+            print("    " + regression)
+    return 1 if failed or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
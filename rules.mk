@@ -17,10 +17,29 @@ tg.out := ${build_dir_root}${tg_build}${path_sep}${tg_executable}${exe_ext}
 ${tg.out}: private override BUILD := ${tg_build}
 ${tg.out}: private options.cl.exception := -EHs
 ${tg.out}: private warnings.gcc += -Wno-missing-field-initializers
+${tg.out}: private link_libs.gcc += -pthread
+${tg.out}: private link_libs.clang += -pthread
 ${tg.out}: ${tg_src}*.cpp ${tg_src}*.h ${tg_external}tm/* ${tg_ucd_h} ${tg_ucd_c}
 	${hide}echo Compiling $@.
 	${hide}$(call cxx_compile_and_link, ${tg_src}main.cpp, $@, ${tg_external} ${tg_src})
 
+# libtg shared library, see src/libtg.h.
+
+libtg.out := ${build_dir_root}${tg_build}${path_sep}libtg${dll_ext}
+${libtg.out}: private override BUILD := ${tg_build}
+${libtg.out}: private options.cl.exception := -EHs
+${libtg.out}: private warnings.gcc += -Wno-missing-field-initializers
+${libtg.out}: private options.gcc += -fPIC -fvisibility=hidden
+${libtg.out}: private options.clang += -fPIC -fvisibility=hidden
+${libtg.out}: private link_options.gcc += -shared
+${libtg.out}: private link_options.clang += -shared
+${libtg.out}: private link_options.cl += -DLL
+${libtg.out}: private link_libs.gcc += -pthread
+${libtg.out}: private link_libs.clang += -pthread
+${libtg.out}: ${tg_src}*.cpp ${tg_src}*.h ${tg_external}tm/* ${tg_ucd_h} ${tg_ucd_c}
+	${hide}echo Compiling $@.
+	${hide}$(call cxx_compile_and_link, ${tg_src}libtg.cpp, $@, ${tg_external} ${tg_src})
+
 # Generate unicode data dynamically, if generator is part of the build system.
 # Otherwise the generated files should already be in the src folder, which will get automatically used.
 
@@ -42,14 +42,58 @@ struct custom_base_t {
     virtual std::unique_ptr<custom_iterator_t> to_iterateble() const { return {}; }
 };
 
+// Custom types whose values are stored inline in any_t::data instead of as a heap allocated custom_base_t.
+// Inline values are copied bitwise and own nothing, so they must point into memory that outlives them, unless the type
+// provides copy and destroy.
+struct custom_inline_type_t {
+    // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
+    int (*print_to_string)(const any_t& value, char* buffer, size_t buffer_len, const tml::PrintFormat& initial);
+    std::unique_ptr<custom_iterator_t> (*to_iterateble)(const any_t& value);
+    // Optional: Called with any_t::data when values are copied or destroyed, for values that own what data points to.
+    void* (*copy)(void* data) = nullptr;
+    void (*destroy)(void* data) = nullptr;
+};
+
+// Defined by the extensions, returns nullptr for custom types that are stored as custom_base_t.
+const custom_inline_type_t* find_custom_inline_type(typeid_enum_underlying id);
+
+// Payload of strings and arrays. Copies of an any_t share the payload and only clone it once it is modified while it is
+// shared, see any_t::as_mutable_string and any_t::as_mutable_array. Values are never shared between threads, so the
+// reference count doesn't need to be atomic.
+template <class T>
+struct shared_payload_t {
+    T value;
+    int ref_count = 1;
+    // References to elements were handed out that may be written through, see any_t::pin_array.
+    bool pinned = false;
+};
+using string_payload_t = shared_payload_t<string>;
+using array_payload_t = shared_payload_t<vector<any_t>>;
+
+// Heap allocations made for values on the current thread, printed with --stats.
+struct value_allocation_stats_t {
+    size_t payloads = 0;          // Strings, arrays and matched patterns.
+    size_t small_strings = 0;     // Strings that were stored inline instead, see any_t::small_string.
+    size_t borrowed_strings = 0;  // Strings that point into memory they don't own, see make_any_borrowed.
+};
+thread_local value_allocation_stats_t value_allocations;
+
 struct any_t {
+    static constexpr int small_string_capacity = 7;
+
     typeid_info type = {tid_undefined, 0};
+    // Strings of up to small_string_capacity bytes are stored inline in small_string instead of a payload, null
+    // terminated like std::string. Longer strings can be borrowed instead, data then points to memory that outlives
+    // the value, see make_any_borrowed. Only meaningful for strings: the size of small and borrowed strings, negative
+    // if the string is stored in a payload.
+    int32_t string_size = -1;
     union {
         void* data = nullptr;
         bool b;
         int i;
         range_t range;
         any_t* ref;
+        char small_string[small_string_capacity + 1];
     };
 
     explicit operator bool() const { return type.id != tid_undefined || type.array_level > 0; };
@@ -58,6 +102,7 @@ struct any_t {
     any_t(any_t&& other) {
         memcpy(this, &other, sizeof(any_t));
         other.type = {tid_undefined, 0};
+        other.string_size = -1;
         other.data = nullptr;
     }
     any_t(const any_t& other) { copy_from(other); }
@@ -66,6 +111,7 @@ struct any_t {
             destroy();
             memcpy((void*)this, &other, sizeof(any_t));
             other.type = {tid_undefined, 0};
+            other.string_size = -1;
             other.data = nullptr;
         }
         return *this;
@@ -174,7 +220,8 @@ struct any_t {
             destroy();
             type = new_type;
             if (new_type.array_level > 0) {
-                data = new vector<any_t>();
+                data = new array_payload_t();
+                ++value_allocations.payloads;
             } else {
                 switch (new_type.id) {
                     case tid_int: {
@@ -186,12 +233,13 @@ struct any_t {
                         break;
                     }
                     case tid_string: {
-                        data = new string();
+                        set_string(string_view{});
                         break;
                     }
                     case tid_sum:
                     case tid_pattern: {
                         data = new matched_pattern_instance_t();
+                        ++value_allocations.payloads;
                         break;
                     }
                     case tid_int_range: {
@@ -251,27 +299,102 @@ struct any_t {
         return range;
     }
 
-    vector<any_t>& as_array() {
-        assert(data);
-        assert(type.array_level > 0);
-        return *((vector<any_t>*)data);
-    }
     const vector<any_t>& as_array() const {
         assert(data);
         assert(type.array_level > 0);
-        return *((vector<any_t>*)data);
+        return array_payload()->value;
     }
-    string& as_string() {
+    // Clones the array first if it is shared, so that modifying it doesn't change copies.
+    vector<any_t>& as_mutable_array() {
         assert(data);
+        assert(type.array_level > 0);
+        auto payload = array_payload();
+        if (payload->ref_count > 1) {
+            --payload->ref_count;
+            payload = new array_payload_t{payload->value};
+            ++value_allocations.payloads;
+            data = payload;
+        }
+        return payload->value;
+    }
+    // Like as_mutable_array, for handing out references to elements that may be written through. Copies of a pinned
+    // array clone it right away, so that writes through such references are never visible in copies.
+    vector<any_t>& pin_array() {
+        auto& array = as_mutable_array();
+        array_payload()->pinned = true;
+        return array;
+    }
+    // The returned view is null terminated, except for borrowed strings (see as_c_string). It points into this value
+    // for small strings, so it is only valid as long as this value isn't modified, moved or destroyed.
+    string_view as_string() const {
         assert(type.id == tid_string);
         assert(type.array_level == 0);
-        return *((string*)data);
-    }
-    const string& as_string() const {
+        if (is_small_string()) return {small_string, (size_t)string_size};
         assert(data);
+        if (is_borrowed_string()) return {(const char*)data, (size_t)string_size};
+        return string_payload()->value;
+    }
+    // Like as_string, but always null terminated. Borrowed strings are copied into buffer for that.
+    string_view as_c_string(string* buffer) const {
+        auto str = as_string();
+        if (!is_borrowed_string()) return str;
+        buffer->assign(str.data(), str.size());
+        return *buffer;
+    }
+    // Moves small and borrowed strings into a payload and clones the string first if it is shared, so that modifying it
+    // doesn't change copies.
+    string& as_mutable_string() {
         assert(type.id == tid_string);
         assert(type.array_level == 0);
-        return *((string*)data);
+        if (string_size >= 0) {
+            auto payload = new string_payload_t{string(as_string().data(), (size_t)string_size)};
+            ++value_allocations.payloads;
+            string_size = -1;
+            data = payload;
+            return payload->value;
+        }
+        assert(data);
+        auto payload = string_payload();
+        if (payload->ref_count > 1) {
+            --payload->ref_count;
+            payload = new string_payload_t{payload->value};
+            ++value_allocations.payloads;
+            data = payload;
+        }
+        return payload->value;
+    }
+    // Only for values that are strings already or were just destroyed.
+    void set_string(string_view str) {
+        if (str.size() <= (size_t)small_string_capacity) {
+            memcpy(small_string, str.data(), str.size());
+            small_string[str.size()] = 0;
+            string_size = (int32_t)str.size();
+            ++value_allocations.small_strings;
+        } else {
+            data = new string_payload_t{string(str.data(), str.size())};
+            string_size = -1;
+            ++value_allocations.payloads;
+        }
+    }
+    // Only for values that are strings already or were just destroyed. The string must outlive the value and all of its
+    // copies. Small strings are still copied, since that is just as cheap.
+    void set_borrowed_string(string_view str) {
+        if (str.size() <= (size_t)small_string_capacity || str.size() > (size_t)INT32_MAX) {
+            set_string(str);
+        } else {
+            data = (void*)str.data();
+            string_size = (int32_t)str.size();
+            ++value_allocations.borrowed_strings;
+        }
+    }
+    void set_string(string&& str) {
+        if (str.size() <= (size_t)small_string_capacity) {
+            set_string(string_view{str});
+        } else {
+            data = new string_payload_t{move(str)};
+            string_size = -1;
+            ++value_allocations.payloads;
+        }
     }
 
     matched_pattern_instance_t& as_match() {
@@ -301,13 +424,21 @@ struct any_t {
     custom_base_t* as_custom() {
         assert(data);
         assert(is_custom_type(type));
+        assert(!find_custom_inline_type(type.id));
         return (custom_base_t*)data;
     }
     const custom_base_t* as_custom() const {
         assert(data);
         assert(is_custom_type(type));
+        assert(!find_custom_inline_type(type.id));
         return (const custom_base_t*)data;
     }
+    // Iterator over custom values, both stored as custom_base_t or inline.
+    std::unique_ptr<custom_iterator_t> custom_to_iterateble() const {
+        assert(is_custom_type(type));
+        if (auto inline_type = find_custom_inline_type(type.id)) return inline_type->to_iterateble(*this);
+        return as_custom()->to_iterateble();
+    }
 
     bool is_array() const { return type.array_level > 0; };
 
@@ -315,6 +446,7 @@ struct any_t {
         destroy();
         type = {tid_pattern, 0};
         auto match = new matched_pattern_instance_t();
+        ++value_allocations.payloads;
         data = match;
         return *match;
     }
@@ -323,6 +455,7 @@ struct any_t {
         destroy();
         type = {tid_sum, 0};
         auto match = new matched_pattern_instance_t();
+        ++value_allocations.payloads;
         data = match;
         return *match;
     }
@@ -365,13 +498,18 @@ struct any_t {
     }
 
    private:
+    array_payload_t* array_payload() const { return (array_payload_t*)data; }
+    string_payload_t* string_payload() const { return (string_payload_t*)data; }
+    bool is_small_string() const { return string_size >= 0 && string_size <= small_string_capacity; }
+    bool is_borrowed_string() const { return string_size > small_string_capacity; }
+
     void destroy() {
         if (type.array_level > 0) {
-            if (data) delete &as_array();
+            if (data && --array_payload()->ref_count == 0) delete array_payload();
         } else {
             switch (type.id) {
                 case tid_string: {
-                    if (data) delete &as_string();
+                    if (string_size < 0 && data && --string_payload()->ref_count == 0) delete string_payload();
                     break;
                 }
                 case tid_sum:
@@ -380,14 +518,18 @@ struct any_t {
                     break;
                 }
                 default: {
-                    if (is_custom_type(type)) {
-                        if (data) delete as_custom();
+                    if (!is_custom_type(type)) break;
+                    if (auto inline_type = find_custom_inline_type(type.id)) {
+                        if (inline_type->destroy) inline_type->destroy(data);
+                    } else if (data) {
+                        delete as_custom();
                     }
                     break;
                 }
             }
         }
         type = {tid_undefined, 0};
+        string_size = -1;
         data = nullptr;
     }
     void copy_from(const any_t& other) {
@@ -397,23 +539,35 @@ struct any_t {
         assert(other_ptr);
         type = other_ptr->type;
         if (other_ptr->type.array_level > 0) {
-            data = new vector<any_t>(other_ptr->as_array());
+            auto payload = other_ptr->array_payload();
+            if (payload->pinned) {
+                data = new array_payload_t{payload->value};
+                ++value_allocations.payloads;
+            } else {
+                ++payload->ref_count;
+                data = payload;
+            }
         } else {
             switch (other_ptr->type.id) {
                 case tid_string: {
-                    data = new string(other_ptr->as_string());
+                    if (other_ptr->string_size < 0) ++other_ptr->string_payload()->ref_count;
+                    string_size = other_ptr->string_size;
+                    data = other_ptr->data;
                     break;
                 }
                 case tid_sum:
                 case tid_pattern: {
                     data = new matched_pattern_instance_t(other_ptr->as_match());
+                    ++value_allocations.payloads;
                     break;
                 }
                 default: {
-                    if (is_custom_type(type)) {
+                    auto inline_type = is_custom_type(type) ? find_custom_inline_type(type.id) : nullptr;
+                    if (is_custom_type(type) && !inline_type) {
                         data = other_ptr->as_custom()->clone();
                     } else {
                         memcpy((void*)this, other_ptr, sizeof(any_t));
+                        if (inline_type && inline_type->copy) data = inline_type->copy(data);
                     }
                     break;
                 }
@@ -422,6 +576,8 @@ struct any_t {
     }
 };
 
+static_assert(sizeof(any_t) == 16, "Small strings must not make any_t larger.");
+
 int tml::snprint(char* buffer, size_t buffer_len, const tml::PrintFormat& initial, const any_t& value) {
     auto value_ptr = value.dereference();
     auto type = value_ptr->type;
@@ -456,7 +612,7 @@ int tml::snprint(char* buffer, size_t buffer_len, const tml::PrintFormat& initia
             return snprint(buffer, buffer_len, "{}", modified, value_ptr->as_bool());
         }
         case tid_string: {
-            return snprint(buffer, buffer_len, "{}", initial, string_view{value_ptr->as_string()});
+            return snprint(buffer, buffer_len, "{}", initial, value_ptr->as_string());
         }
         case tid_pattern:
         case tid_sum: {
@@ -477,6 +633,9 @@ int tml::snprint(char* buffer, size_t buffer_len, const tml::PrintFormat& initia
         }
         default: {
             if (is_custom_type(type)) {
+                if (auto inline_type = find_custom_inline_type(type.id)) {
+                    return inline_type->print_to_string(*value_ptr, buffer, buffer_len, initial);
+                }
                 return value_ptr->as_custom()->print_to_string(buffer, buffer_len, initial);
             }
             return 0;
@@ -512,32 +671,31 @@ any_t make_any(range_t value) {
     return result;
 }
 any_t make_any(string_view str) {
-    auto data = new string(str.data(), str.size());
     any_t result = {};
     result.type = {tid_string, 0};
-    result.data = data;
+    result.set_string(str);
     return result;
 }
 any_t make_any(const char* str) { return make_any(string_view{str}); }
-any_t make_any_unescaped(string_view str) {
-    auto data = new string(to_unescaped_string(str));
-
+any_t make_any(string str) {
     any_t result = {};
     result.type = {tid_string, 0};
-    result.data = data;
+    result.set_string(move(str));
     return result;
 }
-any_t make_any(string str) {
-    auto data = new string(move(str));
+any_t make_any_unescaped(string_view str) { return make_any(to_unescaped_string(str)); }
+// The string must outlive the returned value and all of its copies, see any_t::set_borrowed_string.
+any_t make_any_borrowed(string_view str) {
     any_t result = {};
     result.type = {tid_string, 0};
-    result.data = data;
+    result.set_borrowed_string(str);
     return result;
 }
 
 any_t make_any(vector<any_t> value, int array_level) {
     assert(array_level > 0);
-    auto data = new vector<any_t>(move(value));
+    auto data = new array_payload_t{move(value)};
+    ++value_allocations.payloads;
     any_t result = {};
     result.type = {tid_undefined, (int16_t)array_level};
     result.data = data;
@@ -545,7 +703,8 @@ any_t make_any(vector<any_t> value, int array_level) {
 }
 any_t make_any(vector<any_t> value, typeid_info type) {
     assert(type.array_level > 0);
-    auto data = new vector<any_t>(move(value));
+    auto data = new array_payload_t{move(value)};
+    ++value_allocations.payloads;
     any_t result = {};
     result.type = type;
     result.data = data;
@@ -576,6 +735,16 @@ any_t make_any_custom(custom_base_t* custom) {
     return result;
 }
 
+// Data must outlive the returned value and all of its copies, unless the type copies and destroys it, in which case the
+// value takes ownership of data. See custom_inline_type_t.
+any_t make_any_custom_inline(typeid_info type, void* data) {
+    assert(find_custom_inline_type(type.id));
+    any_t result = {};
+    result.type = type;
+    result.data = data;
+    return result;
+}
+
 any_t make_any_void() {
     any_t result = {};
     result.type = {tid_void, 0};
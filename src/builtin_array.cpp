@@ -19,7 +19,7 @@ builtin_arguments_valid_result_t array_are_append_arguments_valid(const builtin_
 any_t array_call_append(array_view<any_t> arguments) {
     assert(arguments.size() == 2);
     auto lhs = arguments[0].dereference();
-    lhs->as_array().emplace_back(*arguments[1].dereference());
+    lhs->as_mutable_array().emplace_back(*arguments[1].dereference());
     return make_any_void();
 }
 
@@ -33,6 +33,7 @@ any_t array_get_size_property(array_view<any_t> arguments) {
 void init_builtin_array(builtin_type_t* type) {
     type->name = "array";
     type->properties = {{"size", {tid_int, 0}, array_get_size_property}};
-    type->methods = {{"append", 1, 1, array_are_append_arguments_valid, array_call_append}};
+    type->methods = {{"append", 1, 1, array_are_append_arguments_valid, array_call_append,
+                      /*reads_external_data=*/false, /*modifies_object=*/true}};
     type->is_iteratable = true;
 }
\ No newline at end of file
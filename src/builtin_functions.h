@@ -68,7 +68,7 @@ builtin_arguments_valid_result_t builtin_are_max_arguments_valid(const builtin_s
     return result;
 }
 any_t builtin_max(array_view<any_t> arguments) {
-    array_view<any_t> args;
+    array_view<const any_t> args;
     if (arguments.size() == 1) {
         auto single = arguments[0].dereference();
         if (single->is_array()) {
@@ -83,7 +83,7 @@ any_t builtin_max(array_view<any_t> arguments) {
 
     if (args.empty()) return make_any(0);
 
-    any_t* max = args[0].dereference();
+    const any_t* max = args[0].dereference();
     for (size_t i = 1, count = args.size(); i < count; ++i) {
         auto entry = args[i].dereference();
         assert(max->type.is(tid_int, 0));
@@ -92,7 +92,7 @@ any_t builtin_max(array_view<any_t> arguments) {
             max = entry;
         }
     }
-    return make_any_ref(max);
+    return *max;
 }
 
 builtin_arguments_valid_result_t builtin_are_min_arguments_valid(const builtin_state_t& /*state*/,
@@ -125,7 +125,7 @@ builtin_arguments_valid_result_t builtin_are_min_arguments_valid(const builtin_s
     return result;
 }
 any_t builtin_min(array_view<any_t> arguments) {
-    array_view<any_t> args;
+    array_view<const any_t> args;
     if (arguments.size() == 1) {
         auto single = arguments[0].dereference();
         if (single->is_array()) {
@@ -140,7 +140,7 @@ any_t builtin_min(array_view<any_t> arguments) {
 
     if (args.empty()) return make_any(0);
 
-    any_t* min = args[0].dereference();
+    const any_t* min = args[0].dereference();
     for (size_t i = 1, count = args.size(); i < count; ++i) {
         auto entry = args[i].dereference();
         assert(min->type.is(tid_int, 0));
@@ -149,7 +149,7 @@ any_t builtin_min(array_view<any_t> arguments) {
             min = entry;
         }
     }
-    return make_any_ref(min);
+    return *min;
 }
 
 static const builtin_function_t internal_builtin_functions[] = {
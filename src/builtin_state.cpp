@@ -4,6 +4,7 @@ builtin_state_t::builtin_state_t()
     init_builtin_string(&string_type);
 
     init_builtin_json_extension(this);
+    init_builtin_csv_extension(this);
 }
 
 const builtin_type_t* builtin_state_t::get_builtin_type(typeid_info type) {
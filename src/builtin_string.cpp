@@ -43,23 +43,23 @@ builtin_arguments_valid_result_t string_bool_result_check(const builtin_state_t&
 any_t string_empty_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto str = lhs->as_string();
     return make_any(str.empty());
 }
 
 any_t string_get_size_property(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto str = lhs->as_string();
     return make_any((int)str.size());
 }
 
 any_t string_call_append(array_view<any_t> arguments) {
     assert(arguments.size() > 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto& str = lhs->as_mutable_string();
     for (int i = 1, count = (int)arguments.size(); i < count; ++i) {
-        auto& rhs = arguments[i].dereference()->as_string();
+        auto rhs = arguments[i].dereference()->as_string();
         str.insert(str.end(), rhs.begin(), rhs.end());
     }
     return make_any_void();
@@ -142,7 +142,7 @@ any_t string_call_title(array_view<any_t> arguments) {
 any_t string_call_trim(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto str = lhs->as_string();
     auto trimmed = tmsu_trim_n(str.data(), str.data() + str.size());
     return make_any(std::string(trimmed.first, trimmed.last));
 }
@@ -150,7 +150,7 @@ any_t string_call_trim(array_view<any_t> arguments) {
 any_t string_call_trim_left(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto str = lhs->as_string();
 
     const char* first = str.data();
     const char* last = first + str.size();
@@ -161,7 +161,7 @@ any_t string_call_trim_left(array_view<any_t> arguments) {
 any_t string_call_trim_right(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
+    auto str = lhs->as_string();
 
     const char* first = str.data();
     const char* last = first + str.size();
@@ -193,14 +193,17 @@ builtin_arguments_valid_result_t string_are_split_params_valid(const builtin_sta
 any_t string_call_split(array_view<any_t> arguments) {
     assert(arguments.size() == 2);
 
+    // The tokenizer needs null terminated strings.
+    string str_buffer;
+    string delimiters_buffer;
     auto lhs = arguments[0].dereference();
-    auto& str = lhs->as_string();
-    auto& delimiters = arguments[1].dereference()->as_string();
-    const char* delimiters_str = delimiters.c_str();
+    auto str = lhs->as_c_string(&str_buffer);
+    auto delimiters = arguments[1].dereference()->as_c_string(&delimiters_buffer);
+    const char* delimiters_str = delimiters.data();
 
     vector<any_t> result;
 
-    auto tokenizer = tmsu_tokenizer(str.c_str());
+    auto tokenizer = tmsu_tokenizer(str.data());
     tmsu_view_t token = {};
     while (tmsu_next_token(&tokenizer, delimiters_str, &token)) {
         result.push_back(make_any(std::string(token.first, token.last)));
@@ -274,7 +277,8 @@ any_t string_camel_case_call(array_view<any_t> arguments) {
     assert(lhs->type.is(tid_string, 0));
 
     string result;
-    auto tokenizer = tmsu_tokenizer(lhs->as_string().c_str());
+    string buffer;
+    auto tokenizer = tmsu_tokenizer(lhs->as_c_string(&buffer).data());
     string_view word_view = {};
     bool not_first = false;
     while (case_next_word(&tokenizer, &word_view)) {
@@ -291,7 +295,8 @@ any_t string_pascal_case_call(array_view<any_t> arguments) {
     assert(lhs->type.is(tid_string, 0));
 
     string result;
-    auto tokenizer = tmsu_tokenizer(lhs->as_string().c_str());
+    string buffer;
+    auto tokenizer = tmsu_tokenizer(lhs->as_c_string(&buffer).data());
     string_view word_view = {};
     while (case_next_word(&tokenizer, &word_view)) {
         auto word = to_lower(word_view);
@@ -306,7 +311,8 @@ any_t string_snake_case_call(array_view<any_t> arguments) {
     assert(lhs->type.is(tid_string, 0));
 
     string result;
-    auto tokenizer = tmsu_tokenizer(lhs->as_string().c_str());
+    string buffer;
+    auto tokenizer = tmsu_tokenizer(lhs->as_c_string(&buffer).data());
     string_view word_view = {};
     bool not_first = false;
     while (case_next_word(&tokenizer, &word_view)) {
@@ -323,7 +329,8 @@ any_t string_macro_case_call(array_view<any_t> arguments) {
     assert(lhs->type.is(tid_string, 0));
 
     string result;
-    auto tokenizer = tmsu_tokenizer(lhs->as_string().c_str());
+    string buffer;
+    auto tokenizer = tmsu_tokenizer(lhs->as_c_string(&buffer).data());
     string_view word_view = {};
     bool not_first = false;
     while (case_next_word(&tokenizer, &word_view)) {
@@ -340,7 +347,8 @@ any_t string_kebab_case_call(array_view<any_t> arguments) {
     assert(lhs->type.is(tid_string, 0));
 
     string result;
-    auto tokenizer = tmsu_tokenizer(lhs->as_string().c_str());
+    string buffer;
+    auto tokenizer = tmsu_tokenizer(lhs->as_c_string(&buffer).data());
     string_view word_view = {};
     bool not_first = false;
     while (case_next_word(&tokenizer, &word_view)) {
@@ -368,9 +376,10 @@ builtin_arguments_valid_result_t string_check_starts_with(const builtin_state_t&
 }
 
 any_t string_call_starts_with(array_view<any_t> arguments) {
-    auto& lhs = arguments[0].dereference()->as_string();
-    auto& rhs = arguments[1].dereference()->as_string();
-    return make_any(lhs.starts_with(rhs));
+    auto lhs = arguments[0].dereference()->as_string();
+    auto rhs = arguments[1].dereference()->as_string();
+    if (lhs.size() < rhs.size()) return make_any(false);
+    return make_any(tmsu_equals_n(lhs.begin(), lhs.begin() + rhs.size(), rhs.begin(), rhs.end()));
 }
 
 builtin_arguments_valid_result_t string_are_arguments_int(const builtin_state_t& /*state*/,
@@ -392,7 +401,7 @@ builtin_arguments_valid_result_t string_are_arguments_int(const builtin_state_t&
 }
 
 any_t string_call_substr(array_view<any_t> arguments) {
-    auto& lhs = arguments[0].dereference()->as_string();
+    auto lhs = arguments[0].dereference()->as_string();
     auto stream = tmu_utf8_make_stream_n(lhs.data(), lhs.size());
     if (arguments.size() == 2) {
         auto rhs = arguments[1].dereference()->as_int();
@@ -430,13 +439,14 @@ builtin_arguments_valid_result_t string_find_args(const builtin_state_t& /*state
 }
 
 any_t string_call_find(array_view<any_t> arguments) {
-    auto& lhs = arguments[0].dereference()->as_string();
-    auto& rhs = arguments[1].dereference()->as_string();
-    return make_any((int)lhs.find(rhs));
+    auto lhs = arguments[0].dereference()->as_string();
+    auto rhs = arguments[1].dereference()->as_string();
+    auto it = std::search(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    return make_any((it != lhs.end() || rhs.empty()) ? (int)(it - lhs.begin()) : -1);
 }
 
 any_t string_call_escape(array_view<any_t> arguments) {
-    auto& lhs = arguments[0].dereference()->as_string();
+    auto lhs = arguments[0].dereference()->as_string();
     std::string result;
     result.reserve(lhs.size());
     for (auto c : lhs) {
@@ -452,7 +462,8 @@ void init_builtin_string(builtin_type_t* type) {
     type->properties = {{"size", {tid_int, 0}, string_get_size_property}};
     type->methods = {
         {"empty", 0, 0, string_bool_result_check, string_empty_call},
-        {"append", 1, -1, string_are_append_arguments_valid, string_call_append},
+        {"append", 1, -1, string_are_append_arguments_valid, string_call_append, /*reads_external_data=*/false,
+         /*modifies_object=*/true},
         {"lower", 0, 0, string_no_arguments_method, string_call_lower},
         {"upper", 0, 0, string_no_arguments_method, string_call_upper},
         {"title", 0, 0, string_no_arguments_method, string_call_title},
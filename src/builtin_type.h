@@ -54,6 +54,17 @@ struct builtin_function_t {
     int max_params;  // Can be -1 to denote open endedness.
     builtin_check_pointer check;
     builtin_call_pointer call;
+    // Calls are never evaluated during processing, since their result may change between invocations.
+    bool reads_external_data = false;
+    bool modifies_object = false;  // Methods only, whether the value the method is called on is modified.
+};
+
+// Thrown by calls on argument values that are invalid, which checks can't detect since they only see types. The error
+// is reported at the argument and the call returns result, so that the script goes on with a value of the right type.
+struct builtin_argument_error_t {
+    const char* message;
+    int argument_index;  // Methods get this as argument 0.
+    any_t result;
 };
 
 struct builtin_property_t {
@@ -69,6 +80,7 @@ struct builtin_type_t {
     vector<builtin_operator_t> operators;
 
     bool is_iteratable = false;
+    typeid_info element_type = {tid_undefined, 0};  // Type of values when iterated, undefined if it's the type itself.
 
     const builtin_operator_t* get_operator(builtin_operator_type_enum op) const {
         for (auto& entry : operators) {
@@ -0,0 +1,160 @@
+/*
+Generator bodies and the toplevel segment get lowered into a flat instruction stream after processing
+(see lower_bytecode.cpp), which vm_execute in invoke_vm.cpp runs instead of walking statements and expressions.
+Types are already inferred at that point, so int and bool operations are emitted as typed instructions.
+*/
+
+enum vm_opcode_enum : uint8_t {
+    // Output.
+    op_push_line,       // a: preceding newlines, b: additional indentation, c: additional spaces.
+    op_pop_line,        // b: additional indentation, c: additional spaces.
+    op_output_literal,  // a: literal index, b: spaces.
+    op_output_comma,    // a: nested for statement index, b: space after comma, c: spaces.
+    op_begin_output,    // a: spaces that apply while the output expression is evaluated.
+    op_output_value,    // Pops value. a: format index, b: spaces.
+    op_enter_output_target,  // Pops path. a: target after the output statement if path is not a string.
+    op_leave_output_target,
+
+    // Control flow.
+    op_jump,                // a: target.
+    op_jump_if_false,       // Pops condition. a: target.
+    op_jump_if_false_keep,  // a: target. Condition stays on the stack if jumping, otherwise it is popped.
+    op_jump_if_true_keep,   // a: target. Condition stays on the stack if jumping, otherwise it is popped.
+    op_pin_array,           // Pins the array on top of the stack if there is one, see any_t::pin_array.
+    op_for_begin,           // Pops container. a: loop slot, b: variable stack index, c: target if container is empty.
+    op_for_next,            // a: loop slot, b: variable stack index, c: target of loop body.
+    op_for_end,             // a: loop slot.
+    op_profile_iteration,   // a: for statement index. Only emitted when profiling.
+    op_return,
+
+    // Variables.
+    op_load_local,   // a: stack index. Pushes reference to stack value.
+    op_store_local,  // Pops value. a: stack index.
+    op_init_local,   // a: stack index, b: type id, c: array level.
+
+    // Values.
+    op_push_int,         // a: value.
+    op_push_bool,        // a: value.
+    op_push_constant,    // a: constant index.
+    op_make_array,       // Pops b entries. a: expression index.
+    op_eval_expression,  // a: expression index. Fallback that evaluates expression tree.
+
+    // Typed operations. Operand a is always the expression index for diagnostics.
+    op_to_bool,
+    op_to_int,
+    op_not,
+    op_negate,
+    op_mul,
+    op_div,
+    op_mod,
+    op_add,
+    op_sub,
+    op_lt,
+    op_lte,
+    op_gt,
+    op_gte,
+    op_eq_int,     // b: negate result.
+    op_eq_string,  // b: negate result.
+    op_eq,         // b: negate result.
+
+    // Operations on references and builtins.
+    op_subscript,
+    op_dot,
+    op_assign,
+    op_call_function,   // Pops b arguments and the function. a: expression index.
+    op_call_method,     // Pops b arguments and this. a: expression index.
+    op_call_generator,  // Pops generator. a: expression index.
+};
+
+struct vm_instruction_t {
+    vm_opcode_enum op;
+    int a;
+    int b;
+    int c;
+};
+
+// Instruction range of an expression evaluated by a statement.
+// Runtime errors inside the range resume at last with an undefined value, like evaluate_expression_or_null.
+struct vm_expression_range_t {
+    int first;
+    int last;
+};
+
+struct vm_program_t {
+    vector<vm_instruction_t> code;
+    vector<any_t> constants;
+    vector<string_view> literals;
+    vector<PrintFormat> formats;
+    vector<const expression_t*> expressions;
+    vector<vm_expression_range_t> expression_ranges;
+    vector<const for_t*> for_statements;
+
+    int loop_slots = 0;    // Max number of nested for statements.
+    int max_operands = 0;  // Max operand stack size.
+};
+
+// How many values an instruction leaves on the operand stack when execution falls through to the next instruction.
+int vm_operand_delta(const vm_instruction_t& instruction) {
+    switch (instruction.op) {
+        case op_push_line:
+        case op_pop_line:
+        case op_output_literal:
+        case op_output_comma:
+        case op_begin_output:
+        case op_leave_output_target:
+        case op_jump:
+        case op_pin_array:
+        case op_for_next:
+        case op_for_end:
+        case op_profile_iteration:
+        case op_return:
+        case op_init_local:
+        case op_to_bool:
+        case op_to_int:
+        case op_not:
+        case op_negate:
+        case op_dot:
+        case op_call_generator: {
+            return 0;
+        }
+        case op_load_local:
+        case op_push_int:
+        case op_push_bool:
+        case op_push_constant:
+        case op_eval_expression: {
+            return 1;
+        }
+        case op_output_value:
+        case op_enter_output_target:
+        case op_jump_if_false:
+        case op_jump_if_false_keep:
+        case op_jump_if_true_keep:
+        case op_for_begin:
+        case op_store_local:
+        case op_mul:
+        case op_div:
+        case op_mod:
+        case op_add:
+        case op_sub:
+        case op_lt:
+        case op_lte:
+        case op_gt:
+        case op_gte:
+        case op_eq_int:
+        case op_eq_string:
+        case op_eq:
+        case op_subscript:
+        case op_assign: {
+            return -1;
+        }
+        case op_make_array: {
+            return 1 - instruction.b;
+        }
+        case op_call_function:
+        case op_call_method: {
+            return -instruction.b;
+        }
+    }
+    assert(0 && "Unhandled switch case.");
+    return 0;
+}
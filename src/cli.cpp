@@ -3,8 +3,16 @@ struct cli_options {
     vector<const char*> include_dirs;
     vector<char> piped_input;
     const char* output_file;
+    const char* depfile;
+    const char* cache_directory;
+    const char* batch_file;
+    const char* profile_file;
+    execution_engine_enum engine;
     bool load_sources_from_dot_tg_folder;
     bool verbose;
+    bool write_if_changed;
+    bool profile;
+    bool stats;
     bool valid;
 
     tmcli_args remaining;
@@ -14,10 +22,24 @@ enum {
     cli_option_output_file,
     cli_option_include_dir,
     cli_option_verbose,
+    cli_option_engine,
+    cli_option_write_if_changed,
+    cli_option_depfile,
+    cli_option_cache,
+    cli_option_batch,
+    cli_option_profile,
+    cli_option_stats,
 };
 static const tmcli_option options[] = {{"o", "output", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
                                        {"I", "include", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
-                                       {"v", "verbose", CLI_NO_ARGUMENT, CLI_OPTIONAL_OPTION}};
+                                       {"v", "verbose", CLI_NO_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"e", "engine", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"w", "write-if-changed", CLI_NO_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"d", "depfile", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"c", "cache", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"b", "batch", CLI_REQUIRED_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"p", "profile", CLI_OPTIONAL_ARGUMENT, CLI_OPTIONAL_OPTION},
+                                       {"s", "stats", CLI_NO_ARGUMENT, CLI_OPTIONAL_OPTION}};
 
 #ifdef _WIN32
 #define isatty _isatty
@@ -32,6 +54,8 @@ cli_options parse_cli(char const* const* args, int args_count) {
     MAYBE_UNUSED(cli_parser);
 
     cli_options result = {};
+    result.engine = engine_ast;  // The vm is opt-in until it is shown to match the tree walker.
+    bool valid_arguments = true;
 
     tmcli_parsed_option parsed = {};
     while (tmcli_next(&cli_parser, &parsed)) {
@@ -49,15 +73,61 @@ cli_options parse_cli(char const* const* args, int args_count) {
                     result.verbose = true;
                     break;
                 }
+                case cli_option_engine: {
+                    string_view engine = parsed.argument;
+                    if (engine == "ast") {
+                        result.engine = engine_ast;
+                    } else if (engine == "vm") {
+                        result.engine = engine_vm;
+                    } else {
+                        print(stderr, "{}: Unknown engine \"{}\", expected \"ast\" or \"vm\".\n", args[0], engine);
+                        valid_arguments = false;
+                    }
+                    break;
+                }
+                case cli_option_write_if_changed: {
+                    result.write_if_changed = true;
+                    break;
+                }
+                case cli_option_depfile: {
+                    result.depfile = parsed.argument;
+                    break;
+                }
+                case cli_option_cache: {
+                    // Existing directory that parsed files are cached in, see parse_cache.cpp.
+                    result.cache_directory = parsed.argument;
+                    break;
+                }
+                case cli_option_batch: {
+                    result.batch_file = parsed.argument;
+                    break;
+                }
+                case cli_option_profile: {
+                    // The optional argument is the file that collapsed stacks are written to.
+                    result.profile = true;
+                    result.profile_file = parsed.argument;
+                    break;
+                }
+                case cli_option_stats: {
+                    result.stats = true;
+                    break;
+                }
             }
         } else {
             result.source_files.push_back(parsed.argument);
         }
     }
 
-    result.valid = tmcli_validate(&cli_parser);
+    result.valid = tmcli_validate(&cli_parser) && valid_arguments;
+    if (result.batch_file && (result.output_file || result.depfile)) {
+        print(stderr, "{}: Output files and depfiles of {} are given per job in the job file.\n", args[0], "--batch");
+        result.valid = false;
+    }
+
+    // Jobs are read from stdin with "--batch -", so it can't be used for the script too.
+    bool batch_from_stdin = result.batch_file && string_view{result.batch_file} == "-";
     if (result.source_files.empty()) {
-        if (!isatty(fileno(stdin))) {
+        if (!batch_from_stdin && !isatty(fileno(stdin))) {
             std::vector<char> input;
             char buffer[2048];
             size_t read_amount = 0;
@@ -87,6 +157,10 @@ cli_options parse_cli(char const* const* args, int args_count) {
     }
 
     if (result.valid) result.remaining = tmcli_get_remaining_args(&cli_parser);
+    if (result.valid && result.batch_file && result.remaining.argc > 0) {
+        print(stderr, "{}: Arguments of {} are given per job in the job file.\n", args[0], "--batch");
+        result.valid = false;
+    }
     return result;
 }
 
@@ -104,6 +178,149 @@ bool close_stream(const char* app, const char* filename, const char* msg, FILE*
     return true;
 }
 
+bool flush_stream(const char* app, const char* filename, const char* msg, FILE* stream) {
+    errno = 0;
+    if (fflush(stream) != 0 || ferror(stream)) {
+        print(stderr, "{} {}: \"{}\": {}.\n", app, msg, filename, std::strerror((errno != 0) ? errno : EIO));
+        return false;
+    }
+    return true;
+}
+
+// Whether the file exists and has exactly the given contents. Sizes are compared first, then the file is compared in
+// chunks, so that it doesn't have to be loaded into memory.
+bool file_has_contents(const char* filename, string_view contents) {
+    FILE* file = tmu_fopen(filename, "rb");
+    if (!file) return false;
+
+    bool result = false;
+    if (fseek(file, 0, SEEK_END) == 0 && ftell(file) == (long)contents.size() && fseek(file, 0, SEEK_SET) == 0) {
+        result = true;
+        char buffer[16 * 1024];
+        for (auto cur = contents.begin(), last = contents.end(); cur != last;) {
+            auto amount = min(sizeof(buffer), (size_t)(last - cur));
+            if (fread(buffer, 1, amount, file) != amount || memcmp(buffer, cur, amount) != 0) {
+                result = false;
+                break;
+            }
+            cur += amount;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+// Writes the files of $output statements once invocation is done. Files are independent of each other, so they are
+// written concurrently by a small pool of threads.
+bool write_output_targets(const char* app, const vector<unique_ptr<output_target_t>>& targets, bool write_if_changed) {
+    if (targets.empty()) return true;
+
+    vector<int> errors(targets.size(), 0);  // Value of errno for each failed target.
+    std::atomic<size_t> next_target = {0};
+    auto write_targets = [&]() {
+        for (auto i = next_target++; i < targets.size(); i = next_target++) {
+            auto target = targets[i].get();
+            auto& sink = target->output.sink;
+            if (write_if_changed && file_has_contents(target->path.c_str(), sink.buffer)) continue;
+
+            errno = 0;
+            FILE* file = tmu_fopen(target->path.c_str(), "wb");
+            if (!file) {
+                errors[i] = (errno != 0) ? errno : EIO;
+                continue;
+            }
+            sink.file = file;
+            sink.flush();
+            sink.file = nullptr;
+            errors[i] = sink.write_error;
+            errno = 0;
+            if (fclose(file) != 0 && !errors[i]) errors[i] = (errno != 0) ? errno : EIO;
+        }
+    };
+
+    // The calling thread writes files too.
+    auto thread_count = min<size_t>(targets.size(), max(std::thread::hardware_concurrency(), 1u));
+    thread_count = min<size_t>(thread_count, 8);
+    vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(write_targets);
+    }
+    write_targets();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool result = true;
+    for (size_t i = 0, count = targets.size(); i < count; ++i) {
+        if (errors[i]) {
+            print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to write", targets[i]->path, std::strerror(errors[i]));
+            result = false;
+        }
+    }
+    return result;
+}
+
+// Paths in depfiles are separated by spaces and may contain make variables and comments, so these need escaping.
+void append_depfile_path(std::string* out, string_view path) {
+    for (auto c : path) {
+        switch (c) {
+            case ' ':
+            case '#': {
+                *out += '\\';
+                break;
+            }
+            case '$': {
+                *out += '$';
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        *out += c;
+    }
+}
+
+// Writes a Makefile style dependency file, listing every script and data file that was read as prerequisites of the
+// output files.
+bool write_depfile(const char* app, const char* depfile, const vector<string_view>& outputs,
+                   const parsed_state_t& parsed, bool write_if_changed) {
+    if (outputs.empty()) {
+        print(stderr, "{}: {} requires an output file (-o) or $output statements.\n", app, "--depfile");
+        return false;
+    }
+
+    std::string contents;
+    for (size_t i = 0, count = outputs.size(); i < count; ++i) {
+        if (i > 0) contents += ' ';
+        append_depfile_path(&contents, outputs[i]);
+    }
+    contents += ':';
+    auto add_prerequisite = [&contents](string_view path) {
+        contents += " \\\n  ";
+        append_depfile_path(&contents, path);
+    };
+    for (auto& source_file : parsed.source_files) {
+        // Piped input has no filename.
+        if (!source_file.filename.empty()) add_prerequisite(source_file.filename);
+    }
+    for (auto& data_file : current_file_dependencies->data_files) {
+        add_prerequisite(data_file);
+    }
+    contents += '\n';
+
+    if (write_if_changed && file_has_contents(depfile, contents)) return true;
+
+    errno = 0;
+    FILE* file = tmu_fopen(depfile, "wb");
+    if (!file) {
+        print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to open", depfile, std::strerror(errno));
+        return false;
+    }
+    fwrite(contents.data(), 1, contents.size(), file);
+    return close_stream(app, depfile, "Failed to write to", file);
+}
+
 struct output_stream_t {
     FILE* stream = nullptr;
     const char* filename = nullptr;
@@ -111,13 +328,30 @@ struct output_stream_t {
 
     ~output_stream_t() { close(); }
     void dismiss() { stream = nullptr; }
+    bool open(const char* output_filename) {
+        errno = 0;
+        FILE* file = tmu_fopen(output_filename, "wb");
+        if (!file) {
+            if (errno != 0) {
+                print(stderr, "{} {}: \"{}\": {}.\n", app_name, "Failed to open", output_filename,
+                      std::strerror(errno));
+            } else {
+                print(stderr, "{} {}: \"{}\".\n", app_name, "Failed to open", output_filename);
+            }
+            return false;
+        }
+        retarget(file, output_filename);
+        return true;
+    }
     void retarget(FILE* other, const char* other_filename) {
         stream = other;
         filename = other_filename;
     }
     bool close() {
         if (stream) {
-            bool result = close_stream(app_name, filename, "Failed to write to", stream);
+            // Stdout is shared by all jobs of a batch, so it is only flushed.
+            bool result = (stream == stdout) ? flush_stream(app_name, filename, "Failed to write to", stream)
+                                             : close_stream(app_name, filename, "Failed to write to", stream);
             stream = nullptr;
             return result;
         }
@@ -125,6 +359,181 @@ struct output_stream_t {
     }
 };
 
+// Invocation of the toplevel statements with its own arguments and output files. Either the remaining command line, or
+// one line of a --batch job file.
+struct job_t {
+    std::string output_file;  // Empty for stdout.
+    std::string depfile;
+    vector<std::string> args;  // Appended to argv after the name of the first source file.
+};
+
+bool run_job(const char* app, process_state_t* state, const cli_options& options, const job_t& job) {
+    auto output_file = job.output_file.empty() ? nullptr : job.output_file.c_str();
+
+    // With --write-if-changed the output file is only opened after invocation, when we know that it differs.
+    bool buffer_output = output_file && options.write_if_changed;
+    output_stream_t output_stream = {stdout, "stdout", app};
+    if (output_file && !buffer_output) {
+        if (!output_stream.open(output_file)) return false;
+    }
+
+    // Prepare argv builtin global variable.
+    any_t builtin_argv;
+    {
+        vector<any_t> argv_array;
+        if (!options.source_files.empty()) {
+            argv_array.push_back(make_any(options.source_files[0]));
+        } else {
+            argv_array.push_back(make_any("piped"));
+        }
+        for (auto& arg : job.args) {
+            argv_array.push_back(make_any(arg));
+        }
+        builtin_argv = make_any(move(argv_array), {tid_string, 1});
+    }
+
+    // Output is streamed to the output file while invoking, unless it has to be compared to the existing file first.
+    auto& sink = state->output.sink;
+    if (!buffer_output) sink.file = output_stream.stream;
+    invoke_toplevel(state, move(builtin_argv));
+
+    if (buffer_output) {
+        if (file_has_contents(output_file, sink.buffer)) {
+            if (state->verbose) print(stdout, "\"{}\" is unchanged, not writing.\n", output_file);
+        } else {
+            if (!output_stream.open(output_file)) return false;
+            sink.file = output_stream.stream;
+        }
+    }
+
+    if (!sink.flush()) {
+        print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to write", output_stream.filename,
+              std::strerror(sink.write_error));
+        return false;
+    }
+
+    if (!output_stream.close()) return false;
+    if (!write_output_targets(app, state->output_targets, options.write_if_changed)) return false;
+
+    if (!job.depfile.empty()) {
+        vector<string_view> outputs;
+        if (output_file) outputs.push_back(output_file);
+        for (auto& target : state->output_targets) {
+            outputs.push_back(target->path);
+        }
+        if (!write_depfile(app, job.depfile.c_str(), outputs, *state->data, options.write_if_changed)) return false;
+    }
+    return true;
+}
+
+// Splits a job line into words. Words are separated by whitespace, double quotes group words containing whitespace and
+// backslashes escape the next character. Returns an error message on failure.
+const char* split_job_line(string_view line, vector<std::string>* words) {
+    auto cur = line.begin();
+    auto last = line.end();
+    for (;;) {
+        while (cur != last && isspace((unsigned char)*cur)) ++cur;
+        if (cur == last) break;
+
+        auto& word = words->emplace_back();
+        bool quoted = false;
+        for (; cur != last && (quoted || !isspace((unsigned char)*cur)); ++cur) {
+            if (*cur == '"') {
+                quoted = !quoted;
+            } else if (*cur == '\\') {
+                if (++cur == last) return "Backslash at end of line.";
+                word += *cur;
+            } else {
+                word += *cur;
+            }
+        }
+        if (quoted) return "Unterminated quote.";
+    }
+    return nullptr;
+}
+
+// Parses one line of a job file: "[-o <output>] [-d <depfile>] [--] [arguments...]".
+// Returns an error message on failure, empty lines and lines starting with '#' result in an empty word list.
+const char* parse_job_line(string_view line, vector<std::string>* words, job_t* job) {
+    auto first = find_if(line.begin(), line.end(), [](char c) { return !isspace((unsigned char)c); });
+    if (first == line.end() || *first == '#') return nullptr;
+
+    if (auto error = split_job_line(line, words)) return error;
+    size_t i = 0;
+    for (size_t count = words->size(); i < count; ++i) {
+        auto& word = (*words)[i];
+        if (word == "--") {
+            ++i;
+            break;
+        }
+        std::string* target = nullptr;
+        if (word == "-o") {
+            target = &job->output_file;
+        } else if (word == "-d") {
+            target = &job->depfile;
+        } else {
+            break;
+        }
+        if (++i >= count) return "Missing argument for option.";
+        *target = move((*words)[i]);
+    }
+    job->args.assign(std::make_move_iterator(words->begin() + i), std::make_move_iterator(words->end()));
+    return nullptr;
+}
+
+bool read_line(FILE* file, std::string* line) {
+    line->clear();
+    char buffer[1024];
+    while (fgets(buffer, (int)std::size(buffer), file)) {
+        *line += buffer;
+        if (line->back() == '\n') break;
+    }
+    if (line->empty()) return false;
+    while (!line->empty() && (line->back() == '\n' || line->back() == '\r')) line->pop_back();
+    return true;
+}
+
+// Runs every job of the --batch job file against the already processed scripts, so that parsing and processing only
+// happen once. A job file of "-" reads jobs from stdin as they arrive, stdout is flushed after every job.
+// Failing jobs don't stop the batch.
+bool run_batch(const char* app, process_state_t* state, const cli_options& options) {
+    bool from_stdin = string_view{options.batch_file} == "-";
+    const char* job_filename = from_stdin ? "stdin" : options.batch_file;
+    FILE* file = stdin;
+    if (!from_stdin) {
+        errno = 0;
+        file = tmu_fopen(options.batch_file, "rb");
+        if (!file) {
+            print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to open", job_filename, std::strerror(errno));
+            return false;
+        }
+    }
+
+    bool result = true;
+    int line_number = 0;
+    std::string line;
+    vector<std::string> words;
+    while (read_line(file, &line)) {
+        ++line_number;
+        words.clear();
+        job_t job = {};
+        if (auto error = parse_job_line(line, &words, &job)) {
+            print(stderr, "{}: \"{}\":{}: {}\n", app, job_filename, line_number, error);
+            result = false;
+            continue;
+        }
+        if (words.empty()) continue;
+
+        if (state->verbose) print(stdout, "Running job in line {} of \"{}\".\n", line_number, job_filename);
+        state->reset_invocation();
+        current_file_dependencies->data_files.clear();
+        if (!run_job(app, state, options, job)) result = false;
+    }
+
+    if (!from_stdin) fclose(file);
+    return result;
+}
+
 struct stderr_flush_guard_t {
     ~stderr_flush_guard_t() { fflush(stderr); }
 };
@@ -186,18 +595,17 @@ int main(int internal_argc, char const* internal_argv[])
 
     parsed_state_t parsed = {};
     parsed.verbose = cli_options.verbose;
+    if (cli_options.cache_directory) parsed.cache_directory = cli_options.cache_directory;
+    // Files are collected first and then parsed together, see parse_files.
+    std::vector<std::string> files;
     if (cli_options.piped_input.empty()) {
         assert(cli_options.source_files.size() > 0);
-        for (auto& source_file : cli_options.source_files) {
-            if (!parse_file(&parsed, source_file)) return -1;
-        }
+        files.assign(cli_options.source_files.begin(), cli_options.source_files.end());
     } else {
         string_view contents = {cli_options.piped_input.data(),
                                 cli_options.piped_input.data() + cli_options.piped_input.size()};
         if (!parse_inplace(&parsed, contents)) return -1;
 
-        std::vector<std::string> files;
-
         std::string module_dir;
         {
             auto module_dir_result = tmu_module_directory();
@@ -220,70 +628,56 @@ int main(int internal_argc, char const* internal_argv[])
             auto cwd_files = get_source_files_in_dir(".tg");
             files.insert(files.end(), cwd_files.begin(), cwd_files.end());
         }
-
-        for (auto& source_file : files) {
-            if (!parse_file(&parsed, source_file)) return -1;
-        }
     }
 
     for (auto& dir : cli_options.include_dirs) {
         if (parsed.verbose) {
             print(stdout, "Parsing source files in included directory \"{}\".\n", dir);
         }
-        auto files = get_source_files_in_dir(dir);
-        for (auto& source_file : files) {
-            if (!parse_file(&parsed, source_file)) return -1;
-        }
+        auto dir_files = get_source_files_in_dir(dir);
+        files.insert(files.end(), dir_files.begin(), dir_files.end());
     }
+    if (!parse_files(&parsed, files)) return -1;
 
     if (parsed.verbose) {
         print(stdout, "Finished parsing of source files, now processing.\n");
     }
     process_state_t process_state = {&parsed};
     if (!process_parsed_data(&process_state)) return -1;
+    process_state.engine = cli_options.engine;
+    // Set before lowering, since the lowered for statements only count their iterations when profiling.
+    profiler_t profiler;
+    if (cli_options.profile) process_state.profiler = &profiler;
+    if (process_state.engine == engine_vm) lower_toplevel_to_bytecode(&process_state);
     if (parsed.verbose) {
         print(stdout, "Finished processing, outputting:\n\n");
     }
 
-    output_stream_t output_stream = {stdout, "stdout", app};
-    if (cli_options.output_file) {
-        errno = 0;
-        FILE* outfile = tmu_fopen(cli_options.output_file, "wb");
-        if (!outfile) {
-            if (errno != 0) {
-                print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to open", cli_options.output_file,
-                      std::strerror(errno));
-            } else {
-                print(stderr, "{} {}: \"{}\".\n", app, "Failed to open", cli_options.output_file);
-            }
-            return -1;
+    bool result = true;
+    if (cli_options.batch_file) {
+        result = run_batch(app, &process_state, cli_options);
+    } else {
+        job_t job = {};
+        if (cli_options.output_file) job.output_file = cli_options.output_file;
+        if (cli_options.depfile) job.depfile = cli_options.depfile;
+        for (int i = 0; i < cli_options.remaining.argc; ++i) {
+            job.args.push_back(cli_options.remaining.argv[i]);
         }
-        output_stream.retarget(outfile, cli_options.output_file);
+        result = run_job(app, &process_state, cli_options, job);
     }
-
-    // Prepare argv builtin global variable.
-    any_t builtin_argv;
-    {
-        vector<any_t> argv_array;
-        if (!cli_options.source_files.empty()) {
-            argv_array.push_back(make_any(cli_options.source_files[0]));
-        } else {
-            argv_array.push_back(make_any("piped"));
-        }
-        for (int i = 0; i < cli_options.remaining.argc; ++i) {
-            argv_array.push_back(make_any(cli_options.remaining.argv[i]));
+    if (cli_options.profile) {
+        profile_print_report(stderr, process_state);
+        if (cli_options.profile_file && !profile_write_collapsed_stacks(app, cli_options.profile_file, profiler)) {
+            result = false;
         }
-        builtin_argv = make_any(move(argv_array), {tid_string, 1});
     }
-
-    invoke_toplevel(&process_state, move(builtin_argv));
-
-    auto write_result = print(output_stream.stream, "{}", process_state.output.stream);
-    if (write_result != TM_OK) {
-        print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to write", output_stream.filename, std::strerror(errno));
-        return -1;
+    if (cli_options.stats) {
+        auto arena = parsed.allocator->stats();
+        print(stderr, "Arena: {} bytes used of {} bytes in {} blocks, {} bytes wasted at the end of blocks.\n",
+              arena.used, arena.reserved, arena.blocks, arena.wasted);
+        print(stderr,
+              "Allocated {} strings, arrays and patterns, stored {} small strings inline, borrowed {} strings.\n",
+              value_allocations.payloads, value_allocations.small_strings, value_allocations.borrowed_strings);
     }
-
-    if (!output_stream.close()) return -1;
-    return 0;
+    return result ? 0 : -1;
 }
@@ -0,0 +1,432 @@
+/*
+CSV and TSV tables, see read_csv. The file is memory mapped and split into fields once when it is read. Fields are
+stored by column as offsets into the mapping, so the table needs a few bytes per field in addition to the file,
+instead of a string per field. Values read from tables are borrowed strings pointing into the mapping.
+
+The first record is the header and names the columns. Fields follow RFC 4180: they can be quoted with '"', quoted
+fields may contain delimiters, line breaks and '"' escaped as "". Records with fewer fields than the header are padded
+with empty fields, additional fields are ignored. Empty lines are skipped.
+
+Tables keep their file mapped while they are alive (see mapped_file_t in lazy_json.h), so CSV files must not be
+modified in place while tg runs either.
+*/
+
+// Wrap all types that we want to expose to the language.
+enum csv_extension_types : typeid_enum_underlying { tid_csv_table = tid_json_lines + 1, tid_csv_row };
+
+struct csv_field_t {
+    uint32_t offset;  // Of the text in the mapped file, without quotes.
+    uint32_t size;    // The highest bit is set for quoted fields that contain escaped quotes.
+};
+
+constexpr uint32_t csv_escaped_bit = 0x80000000u;
+
+struct csv_column_t {
+    std::string name;
+    vector<csv_field_t> fields;  // One per row.
+};
+
+struct csv_table_t {
+    mapped_file_t file;
+    vector<csv_column_t> columns;
+    size_t rows = 0;
+    std::unordered_map<string_view, size_t, json_key_hash> column_indices;  // Column by name, the first of duplicates.
+    // Fields with escaped quotes, decoded when they are first read. By offset of the field.
+    std::deque<std::string> decoded_strings;
+    std::unordered_map<uint32_t, string_view> decoded_fields;
+
+    // Offsets and sizes are 32 bit, so files must be smaller than 2 GiB.
+    bool open(const char* filename, char delimiter) {
+        if (!file.open(filename)) return false;
+        if (file.size >= csv_escaped_bit) return false;
+
+        const char* p = file.data;
+        const char* end = file.data + file.size;
+        if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+        if (p == end) return true;
+
+        vector<csv_field_t> fields;
+        p = parse_record(p, end, delimiter, &fields);
+        columns.resize(fields.size());
+        for (size_t i = 0; i < fields.size(); ++i) {
+            auto name = field_value(fields[i]);
+            columns[i].name.assign(name.data(), name.size());
+        }
+        for (size_t i = 0; i < columns.size(); ++i) column_indices.emplace(columns[i].name, i);
+
+        // Line breaks are an upper bound of the number of rows, unless quoted fields contain many of them.
+        size_t lines = 1;
+        for (const char* q = p; (q = (const char*)memchr(q, '\n', (size_t)(end - q))) != nullptr; ++q) ++lines;
+        for (auto& column : columns) column.fields.reserve(lines);
+
+        while (p < end) {
+            p = parse_record(p, end, delimiter, &fields);
+            if (fields.size() == 1 && fields[0].size == 0) continue;
+            for (size_t i = 0, count = columns.size(); i < count; ++i) {
+                columns[i].fields.push_back((i < fields.size()) ? fields[i] : csv_field_t{0, 0});
+            }
+            ++rows;
+        }
+        return true;
+    }
+
+    // Column by name or index, -1 if there is none.
+    int find_column(const any_t* key) const {
+        if (key->type.is(tid_string, 0)) {
+            auto it = column_indices.find(key->as_string());
+            return (it != column_indices.end()) ? (int)it->second : -1;
+        }
+        int index = 0;
+        if (!key->try_convert_to_int(&index) || index < 0 || (size_t)index >= columns.size()) return -1;
+        return index;
+    }
+
+    string_view field_value(csv_field_t field) {
+        string_view raw = {file.data + field.offset, field.size & ~csv_escaped_bit};
+        if (!(field.size & csv_escaped_bit)) return raw;
+
+        auto& value = decoded_fields[field.offset];
+        if (!value.data()) {
+            auto& decoded = decoded_strings.emplace_back();
+            const char* p = raw.data();
+            const char* end = raw.data() + raw.size();
+            while (auto quote = (const char*)memchr(p, '"', (size_t)(end - p))) {
+                // Keep the first of two quotes.
+                decoded.append(p, quote + 1);
+                p = quote + 2;
+            }
+            decoded.append(p, end);
+            value = {decoded.data(), decoded.size()};
+        }
+        return value;
+    }
+    string_view field_value(size_t column, size_t row) { return field_value(columns[column].fields[row]); }
+
+   private:
+    // Splits the record starting at p into fields, returns the start of the next record.
+    const char* parse_record(const char* p, const char* end, char delimiter, vector<csv_field_t>* fields) {
+        fields->clear();
+        for (;;) {
+            csv_field_t field = {};
+            if (p < end && *p == '"') {
+                const char* first = ++p;
+                bool escaped = false;
+                for (;;) {
+                    p = (const char*)memchr(p, '"', (size_t)(end - p));
+                    if (!p) {
+                        // Unterminated quotes extend to the end of the file.
+                        p = end;
+                        break;
+                    }
+                    if (p + 1 < end && p[1] == '"') {
+                        escaped = true;
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                field = {(uint32_t)(first - file.data), (uint32_t)(p - first) | (escaped ? csv_escaped_bit : 0)};
+                if (p < end) ++p;
+                // Anything between the closing quote and the next delimiter is ignored.
+                while (p < end && *p != delimiter && *p != '\n' && *p != '\r') ++p;
+            } else {
+                const char* first = p;
+                while (p < end && *p != delimiter && *p != '\n' && *p != '\r') ++p;
+                field = {(uint32_t)(first - file.data), (uint32_t)(p - first)};
+            }
+            fields->push_back(field);
+            if (p < end && *p == delimiter) {
+                ++p;
+                continue;
+            }
+            break;
+        }
+        if (p < end && *p == '\r') ++p;
+        if (p < end && *p == '\n') ++p;
+        return p;
+    }
+};
+
+/*
+Tables that were read while running, like json_document_cache_t. Tables are kept alive until the cache is destroyed and
+replaced tables until the end of the invocation that replaced them, so that rows and strings read from tables can point
+into them.
+*/
+struct csv_table_cache_t {
+    struct entry_t {
+        bool loaded = false;
+        char delimiter = 0;
+        std::shared_ptr<csv_table_t> table;
+    };
+
+    file_cache_t<entry_t> files;
+
+    // Table of the file, read again if the file or the delimiter changed. Returns nullptr if the file can't be read.
+    std::shared_ptr<csv_table_t> find(string_view filename, char delimiter) {
+        auto entry = files.find(filename);
+        if (!entry) return nullptr;
+        if (entry->loaded && entry->delimiter == delimiter) return entry->table;
+        if (entry->loaded) files.replace(entry);
+
+        entry->loaded = true;
+        entry->delimiter = delimiter;
+        auto table = std::make_shared<csv_table_t>();
+        std::string path(filename.data(), filename.size());
+        if (table->open(path.c_str(), delimiter)) entry->table = move(table);
+        return entry->table;
+    }
+
+    // Frees replaced tables, called once no value of the invocation is left.
+    void release_replaced() { files.release_replaced(); }
+};
+
+csv_table_cache_t default_csv_table_cache;
+thread_local csv_table_cache_t* current_csv_table_cache = &default_csv_table_cache;
+
+// Row of a table, the table is kept alive by the cache.
+struct wrapped_csv_row final : custom_base_t {
+    csv_table_t* table = nullptr;  // Null for rows out of range, which only have empty fields.
+    size_t row = 0;
+
+    wrapped_csv_row() = default;
+    wrapped_csv_row(csv_table_t* table, size_t row) : table(table), row(row) {}
+    virtual ~wrapped_csv_row() override {}
+
+    virtual custom_base_t* clone() const override { return new wrapped_csv_row(table, row); }
+    virtual typeid_info type() const override { return {tid_csv_row, 0}; }
+
+    // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
+    // Rows are printed like string arrays.
+    virtual int print_to_string(char* buffer, size_t buffer_len, const tml::PrintFormat& initial) const override {
+        char* p = buffer;
+        char* last = buffer + buffer_len;
+        if (p < last) *p++ = '[';
+        for (size_t i = 0, count = table ? table->columns.size() : 0; i < count; ++i) {
+            if (i > 0) {
+                if (p < last) *p++ = ',';
+                if (p < last) *p++ = ' ';
+            }
+            auto remaining = (size_t)(last - p);
+            auto print_result = tml::snprint(p, remaining, "{}", initial, table->field_value(i, row));
+            if (print_result < 0 || (size_t)print_result >= remaining) return -1;
+            p += print_result;
+        }
+        if (p < last) *p++ = ']';
+        return (int)(p - buffer);
+    }
+};
+
+struct csv_row_iterator final : custom_iterator_t {
+    csv_table_t* table;
+    size_t row = 0;
+
+    explicit csv_row_iterator(csv_table_t* table) : table(table) {}
+
+    virtual ~csv_row_iterator() override{};
+    virtual any_t next() override {
+        if (!table || row >= table->rows) return {};
+        return make_any_custom(new wrapped_csv_row(table, row++));
+    }
+};
+
+struct wrapped_csv_table final : custom_base_t {
+    std::shared_ptr<csv_table_t> table;  // Null if the file couldn't be read, the table has no rows then.
+
+    wrapped_csv_table() = default;
+    virtual ~wrapped_csv_table() override {}
+
+    virtual custom_base_t* clone() const override {
+        auto result = new wrapped_csv_table();
+        result->table = table;
+        return result;
+    }
+    virtual typeid_info type() const override { return {tid_csv_table, 0}; }
+
+    // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
+    virtual int print_to_string(char* buffer, size_t buffer_len, const tml::PrintFormat& initial) const override {
+        MAYBE_UNUSED(buffer);
+        MAYBE_UNUSED(buffer_len);
+        MAYBE_UNUSED(initial);
+        return -1;
+    }
+
+    virtual std::unique_ptr<custom_iterator_t> to_iterateble() const override {
+        return std::make_unique<csv_row_iterator>(table.get());
+    }
+};
+
+builtin_arguments_valid_result_t read_csv_check(const builtin_state_t& /*state*/,
+                                                array_view<const typeid_info_match> arguments) {
+    builtin_arguments_valid_result_t result = {{tid_string, 0}, {tid_csv_table, 0}};
+    assert(arguments.size() == 1 || arguments.size() == 2);
+    for (int i = 0, count = (int)arguments.size(); i < count; ++i) {
+        if (!arguments[i].is(tid_string, 0)) {
+            result.valid = false;
+            result.invalid_index = i;
+            break;
+        }
+    }
+    return result;
+}
+
+any_t read_csv_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 1 || arguments.size() == 2);
+    string buffer;
+    auto str = arguments[0].dereference()->as_c_string(&buffer);
+    char delimiter = ',';
+    if (arguments.size() == 2) {
+        auto delimiter_string = arguments[1].dereference()->as_string();
+        if (delimiter_string.size() != 1) {
+            auto empty = make_any_custom(new wrapped_csv_table());
+            throw builtin_argument_error_t{"Delimiter must be a single byte.", 1, move(empty)};
+        }
+        delimiter = delimiter_string.data()[0];
+    } else if (str.size() >= 4 && memcmp(str.data() + str.size() - 4, ".tsv", 4) == 0) {
+        delimiter = '\t';
+    }
+
+    auto inner = new wrapped_csv_table();
+    if (auto table = current_csv_table_cache->find(str, delimiter)) {
+        record_file_dependency(str);
+        inner->table = move(table);
+    }
+
+    return make_any_custom(inner);
+}
+
+// Table
+
+builtin_arguments_valid_result_t csv_table_subscript_check(const builtin_state_t& /*state*/,
+                                                           array_view<const typeid_info_match> arguments) {
+    builtin_arguments_valid_result_t result = {{tid_int, 0}, {tid_csv_row, 0}};
+    assert(arguments.size() == 2);
+    assert(arguments[0].is(tid_csv_table, 0));
+    if (!is_convertible(arguments[1], {tid_int, 0})) {
+        result.valid = false;
+        result.invalid_index = 1;
+    }
+    return result;
+}
+
+any_t csv_table_subscript_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 2);
+    auto table = static_cast<const wrapped_csv_table*>(arguments[0].dereference()->as_custom())->table.get();
+    int row = 0;
+    if (!table || !arguments[1].dereference()->try_convert_to_int(&row) || row < 0 || (size_t)row >= table->rows) {
+        return make_any_custom(new wrapped_csv_row());
+    }
+    return make_any_custom(new wrapped_csv_row(table, (size_t)row));
+}
+
+builtin_arguments_valid_result_t csv_table_column_check(const builtin_state_t& /*state*/,
+                                                        array_view<const typeid_info_match> arguments) {
+    builtin_arguments_valid_result_t result = {{tid_string, 0}, {tid_string, 1}};
+    assert(arguments.size() == 2);
+    assert(arguments[0].is(tid_csv_table, 0));
+    if (!arguments[1].is(tid_string, 0) && !is_convertible(arguments[1], {tid_int, 0})) {
+        result.valid = false;
+        result.invalid_index = 1;
+    }
+    return result;
+}
+
+// All fields of a column, by name or index. Empty if there is no such column.
+any_t csv_table_column_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 2);
+    auto table = static_cast<const wrapped_csv_table*>(arguments[0].dereference()->as_custom())->table.get();
+    vector<any_t> fields;
+    int column = table ? table->find_column(arguments[1].dereference()) : -1;
+    if (column >= 0) {
+        fields.reserve(table->rows);
+        for (auto field : table->columns[column].fields) fields.push_back(make_any_borrowed(table->field_value(field)));
+    }
+    return make_any(move(fields), typeid_info{tid_string, 1});
+}
+
+any_t csv_table_size_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 1);
+    auto table = static_cast<const wrapped_csv_table*>(arguments[0].dereference()->as_custom())->table.get();
+    return make_any(table ? (int)table->rows : 0);
+}
+
+any_t csv_table_columns_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 1);
+    auto table = static_cast<const wrapped_csv_table*>(arguments[0].dereference()->as_custom())->table.get();
+    vector<any_t> names;
+    if (table) {
+        for (auto& column : table->columns) names.push_back(make_any_borrowed(column.name));
+    }
+    return make_any(move(names), typeid_info{tid_string, 1});
+}
+
+// Row
+
+builtin_arguments_valid_result_t csv_row_subscript_check(const builtin_state_t& /*state*/,
+                                                         array_view<const typeid_info_match> arguments) {
+    builtin_arguments_valid_result_t result = {{tid_string, 0}, {tid_string, 0}};
+    assert(arguments.size() == 2);
+    assert(arguments[0].is(tid_csv_row, 0));
+    if (!arguments[1].is(tid_string, 0) && !is_convertible(arguments[1], {tid_int, 0})) {
+        result.valid = false;
+        result.invalid_index = 1;
+    }
+    return result;
+}
+
+// Field by column name or index, empty if there is no such column.
+any_t csv_row_subscript_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 2);
+    auto row = static_cast<const wrapped_csv_row*>(arguments[0].dereference()->as_custom());
+    int column = row->table ? row->table->find_column(arguments[1].dereference()) : -1;
+    if (column < 0) return make_any(string_view{});
+    return make_any_borrowed(row->table->field_value((size_t)column, row->row));
+}
+
+any_t csv_row_size_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 1);
+    auto row = static_cast<const wrapped_csv_row*>(arguments[0].dereference()->as_custom());
+    return make_any(row->table ? (int)row->table->columns.size() : 0);
+}
+
+any_t csv_row_index_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 1);
+    auto row = static_cast<const wrapped_csv_row*>(arguments[0].dereference()->as_custom());
+    return make_any((int)row->row);
+}
+
+// Init
+
+void init_builtin_csv_table(builtin_type_t* type) {
+    type->name = "csv_table";
+    type->operators = {
+        {bop_subscript, csv_table_subscript_check, csv_table_subscript_call},
+    };
+    type->properties = {
+        {"size", {tid_int, 0}, csv_table_size_call},
+        {"columns", {tid_string, 1}, csv_table_columns_call},
+    };
+    type->methods = {
+        {"column", 1, 1, csv_table_column_check, csv_table_column_call},
+    };
+    type->is_iteratable = true;
+    type->element_type = {tid_csv_row, 0};
+}
+
+void init_builtin_csv_row(builtin_type_t* type) {
+    type->name = "csv_row";
+    type->operators = {
+        {bop_subscript, csv_row_subscript_check, csv_row_subscript_call},
+    };
+    type->properties = {
+        {"size", {tid_int, 0}, csv_row_size_call},
+        {"index", {tid_int, 0}, csv_row_index_call},
+    };
+}
+
+void init_builtin_csv_extension(builtin_state_t* state) {
+    // read_csv(filename, delimiter): The optional delimiter must be a string of exactly one byte. Without it, files
+    // ending in ".tsv" are tab separated, others comma separated.
+    state->functions.push_back({"read_csv", 1, 2, read_csv_check, read_csv_call, /*reads_external_data=*/true});
+    init_builtin_csv_table(&state->custom_types.emplace_back());
+    init_builtin_csv_row(&state->custom_types.emplace_back());
+}
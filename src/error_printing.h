@@ -12,15 +12,20 @@ string print_string(const char* format, ...) {
 }
 
 #ifdef _DEBUG
-const char* debug_error_file = nullptr;
-int debug_error_line = 0;
+thread_local const char* debug_error_file = nullptr;
+thread_local int debug_error_line = 0;
 #endif
 
+// Set on threads that parse files speculatively (see parse_files), failing files are parsed again on the main thread,
+// which reports the errors.
+thread_local bool suppress_error_output = false;
+
 const int ERROR_MAX_LEN = 100;
 void print_error_context_impl(string_view message, file_data file, stream_loc_t location, int length) {
     // TODO: This function has problems with input that uses tabs.
     // We should replace tabs with four spaces when outputting.
 
+    if (suppress_error_output) return;
     assert(location.file_index == file.index);
     assert(location.offset >= 0 && (size_t)location.offset <= file.contents.size());
     if (location.offset > (int)file.contents.size()) location.offset = (int)file.contents.size();
@@ -134,6 +139,7 @@ void print_error_context_impl(string_view message, source_file_location source)
 }
 
 void print_error_impl(string_view message, file_data file, stream_loc_t location) {
+    if (suppress_error_output) return;
     string_view fn = (file.filename.size()) ? (file.filename) : ("Error");
     tmu_fprintf(stderr, "%.*s(%d:%d): %.*s\n", (int)fn.size(), fn.data(), location.line + 1, location.column + 1,
                 (int)message.size(), message.data());
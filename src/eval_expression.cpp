@@ -29,14 +29,17 @@ bool check_array_of_matches(const any_t* value, typeid_info_match to) {
     return true;
 }
 
-bool string_match_definition(process_state_t* state, const match_type_definition_t& definition, const string& str,
+bool string_match_definition(process_state_t* state, const match_type_definition_t& definition, string_view str,
                              stream_loc_ex_t origin_location, any_t* out, bool print_error);
 
 bool evaluate_value_to_pattern_array(process_state_t* state, const match_type_definition_t* definition,
                                      const any_t& value, stream_loc_ex_t location, any_t* matched_pattern_out) {
     if (value.type.array_level == 0) {
         assert(value.type.is(tid_string, 0));
-        if (!string_match_definition(state, *definition, value.as_string(), location, matched_pattern_out, true)) {
+        // The tokenizer needs a null terminated string.
+        string buffer;
+        auto str = value.as_c_string(&buffer);
+        if (!string_match_definition(state, *definition, str, location, matched_pattern_out, true)) {
             return false;
         }
     } else {
@@ -140,6 +143,26 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_arra
     }
     return make_any(std::move(array), exp->result_type);
 }
+// Builtins like max return references to one of their arguments, which don't outlive the call.
+any_t detach_from_arguments(any_t result, array_view<any_t> arguments) {
+    if (result.type.is(tid_reference, 0) && result.ref >= arguments.begin() && result.ref < arguments.end()) {
+        return *result.ref;
+    }
+    return result;
+}
+any_t call_builtin(process_state_t* state, const expression_call_t* exp, const builtin_function_t* function,
+                   array_view<any_t> arguments) {
+    try {
+        if (!state->profiler) return detach_from_arguments(function->call(arguments), arguments);
+        profile_builtin_scope_t profile_scope{&state->profiler->builtins[function]};
+        return detach_from_arguments(function->call(arguments), arguments);
+    } catch (builtin_argument_error_t& error) {
+        int index = error.argument_index - (exp->method ? 1 : 0);
+        auto location = is_valid_index(exp->arguments.size(), index) ? exp->arguments[index]->location : exp->location;
+        print_error_context(error.message, {state->data->source_files, location});
+        return std::move(error.result);
+    }
+}
 any_t evaluate_expression_concrete(process_state_t* state, const expression_call_t* exp) {
     any_t lhs_ref = evaluate_expression_throws(state, exp->lhs.get());
     auto lhs = lhs_ref.dereference();
@@ -156,13 +179,13 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_call
     if (exp->method) {
         // Add this pointer to arguments.
         arguments.insert(arguments.begin(), make_any_ref(lhs));
-        return exp->method->call(arguments);
+        return call_builtin(state, exp, exp->method, arguments);
     }
     assert(lhs->type.is_callable());
     switch (lhs->type.id) {
         case tid_function: {
             auto builtin_function = lhs->as_function();
-            return builtin_function->call(arguments);
+            return call_builtin(state, exp, builtin_function, arguments);
         }
         case tid_generator: {
             auto generator = lhs->as_generator();
@@ -176,24 +199,12 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_call
     }
     throw tg_exeption("Internal error.", exp->location);
 }
-any_t evaluate_expression_concrete(process_state_t* state, const expression_subscript_t* exp) {
-    any_t result;
-
-    any_t lhs_ref = evaluate_expression_throws(state, exp->lhs.get());
+// Shared by evaluate_expression_concrete and the vm. Both operands are already evaluated.
+any_t evaluate_subscript(process_state_t* state, const expression_subscript_t* exp, any_t& lhs_ref, any_t& rhs_ref) {
     auto lhs = lhs_ref.dereference();
-    const bool is_array = (lhs->type.array_level > 0);
-    const builtin_operator_t* subscript = nullptr;
-    if (!is_array) {
-        auto builtin = state->builtin.get_builtin_type(lhs->type);
-        if (!builtin || (subscript = builtin->get_operator(bop_subscript)) == nullptr) {
-            throw tg_exeption("Expression is not subscriptable.", exp->lhs->location);
-        }
-    }
-
-    any_t rhs_ref = evaluate_expression_throws(state, exp->rhs.get());
     auto rhs = rhs_ref.dereference();
-    if (is_array) {
-        auto& array = lhs->as_array();
+    if (lhs->type.array_level > 0) {
+        const auto& array = exp->mutable_access ? lhs->pin_array() : lhs->as_array();
         int subscript_value = 0;
         bool conversion_success = rhs->try_convert_to_int(&subscript_value);
         // Conversion must succeed, otherwise infer_expression_types failed.
@@ -201,13 +212,25 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_subs
         if (!is_valid_index(array.size(), subscript_value)) {
             throw tg_exeption("Subscript out of range.", exp->rhs->location);
         }
-        result = make_any_ref(&array[subscript_value]);
-    } else {
-        assert(subscript);
-        any_t arguments[2] = {make_any_ref(lhs), make_any_ref(rhs)};
-        result = subscript->call(arguments);
+        auto& entry = array[subscript_value];
+        // Don't hand out references into temporaries, they are destroyed once the caller is done with lhs_ref.
+        if (!lhs_ref.type.is(tid_reference, 0) && !entry.type.is(tid_reference, 0)) return entry;
+        // Only written through if the array was pinned above.
+        return make_any_ref(const_cast<any_t*>(&entry));
     }
-    return result;
+
+    const builtin_operator_t* subscript = nullptr;
+    auto builtin = state->builtin.get_builtin_type(lhs->type);
+    if (!builtin || (subscript = builtin->get_operator(bop_subscript)) == nullptr) {
+        throw tg_exeption("Expression is not subscriptable.", exp->lhs->location);
+    }
+    any_t arguments[2] = {make_any_ref(lhs), make_any_ref(rhs)};
+    return subscript->call(arguments);
+}
+any_t evaluate_expression_concrete(process_state_t* state, const expression_subscript_t* exp) {
+    any_t lhs_ref = evaluate_expression_throws(state, exp->lhs.get());
+    any_t rhs_ref = evaluate_expression_throws(state, exp->rhs.get());
+    return evaluate_subscript(state, exp, lhs_ref, rhs_ref);
 }
 any_t evaluate_expression_concrete(process_state_t* state, const expression_instanceof_t* exp) {
     auto lhs = exp->lhs.get();
@@ -222,9 +245,8 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_inst
     }
     return make_any(false);
 }
-any_t evaluate_expression_concrete(process_state_t* state, const expression_dot_t* exp) {
-    auto value_ref = evaluate_expression_throws(state, exp->lhs.get());
-
+// Shared by evaluate_expression_concrete and the vm. Lhs of the dot expression is already evaluated.
+any_t evaluate_dot_fields(const expression_dot_t* exp, any_t value_ref) {
     auto& fields = exp->fields;
     auto& inferred = exp->inferred;
     assert(inferred.size() == fields.size());
@@ -249,7 +271,14 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_dot_
                     auto field_index = pattern->find_field_index(field.contents);
                     assert(field_index >= 0);
 
-                    value_ref = make_any_ref(&match->field_values[field_index]);
+                    auto& field_value = match->field_values[field_index];
+                    if (value_ref.type.is(tid_reference, 0)) {
+                        value_ref = make_any_ref(&field_value);
+                    } else {
+                        // Value is a temporary that owns field_value, copy before it is destroyed.
+                        any_t copy = field_value;
+                        value_ref = std::move(copy);
+                    }
                 } else {
                     // There can't be an instance of a sum type, it is always a concrete matched pattern.
                     assert(0 && "Internal error.");
@@ -276,6 +305,10 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_dot_
     }
 
     return value_ref;
+}
+any_t evaluate_expression_concrete(process_state_t* state, const expression_dot_t* exp) {
+    auto value_ref = evaluate_expression_throws(state, exp->lhs.get());
+    return evaluate_dot_fields(exp, std::move(value_ref));
 
 #if 0
     if (value->is_array()) {
@@ -544,13 +577,7 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_or_t
     return make_any(rhs_value);
 }
 
-any_t evaluate_expression_concrete(process_state_t* state, const expression_assign_t* exp) {
-    any_t lhs_ref = evaluate_expression_throws(state, exp->lhs.get());
-    auto lhs = lhs_ref.dereference();
-
-    any_t rhs_ref = evaluate_expression_throws(state, exp->rhs.get());
-    auto rhs = rhs_ref.dereference();
-
+void assign_value(any_t* lhs, const any_t* rhs) {
     if (lhs->type.is(tid_int, 0)) {
         *lhs = make_any(rhs->convert_to_int());
     } else if (lhs->type.is(tid_bool, 0)) {
@@ -560,7 +587,11 @@ any_t evaluate_expression_concrete(process_state_t* state, const expression_assi
         assert(lhs->type == rhs->type);
         *lhs = *rhs;
     }
-
+}
+any_t evaluate_expression_concrete(process_state_t* state, const expression_assign_t* exp) {
+    any_t lhs_ref = evaluate_expression_throws(state, exp->lhs.get());
+    any_t rhs_ref = evaluate_expression_throws(state, exp->rhs.get());
+    assign_value(lhs_ref.dereference(), rhs_ref.dereference());
     return make_any_void();
 }
 
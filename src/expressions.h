@@ -64,6 +64,7 @@ using unique_expression_t = monotonic_unique<expression_t>;
 struct symbol_entry_t;
 struct expression_identifier_t : expression_t {
     string_view identifier;
+    int identifier_id = -1;  // Interned identifier, see identifier_table.h.
     union {
         symbol_entry_t* symbol = nullptr;
         const builtin_function_t* builtin_function;
@@ -91,6 +92,7 @@ struct expression_call_t : expression_t {
 
 struct expression_compile_time_evaluated_t : expression_t {
     any_t value;
+    bool is_literal = false;  // Value of a literal in the source, see fold_constant_expression.
 };
 
 struct inferred_field_t {
@@ -126,7 +128,9 @@ struct expression_list_t : expression_t {
 };
 
 struct expression_array_t : expression_list_t {};
-struct expression_subscript_t : expression_two_t {};
+struct expression_subscript_t : expression_two_t {
+    bool mutable_access = false;  // Result is written to, so the array can't share its entries, see any_t::pin_array.
+};
 struct expression_instanceof_t : expression_two_t {};
 struct expression_unary_plus_t : expression_one_t {};
 struct expression_unary_minus_t : expression_one_t {};
@@ -0,0 +1,78 @@
+/*
+Files that builtins read while running, like read_json_document and read_csv, so that scripts reading the same file
+repeatedly only load it once. Entries are keyed by canonical path and are reset if the size or modification time of the
+file changed. Replaced entries are kept until the end of the invocation that replaced them (see release_replaced),
+since values of the invocation can point into them.
+*/
+
+// Size and modification time of a file, with the full resolution of the file system.
+struct file_stamp_t {
+    int64_t size = 0;
+    int64_t modified = 0;  // Nanoseconds on POSIX, 100 nanosecond intervals on Windows.
+
+    bool operator==(const file_stamp_t& other) const { return size == other.size && modified == other.modified; }
+    bool operator!=(const file_stamp_t& other) const { return !(*this == other); }
+};
+
+// Returns false if the file doesn't exist.
+bool get_file_stamp(const char* filename, file_stamp_t* out) {
+#ifdef _WIN32
+    // stat only has a resolution of seconds on Windows.
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data)) return false;
+    out->size = ((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    out->modified = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(filename, &info) != 0) return false;
+    out->size = (int64_t)info.st_size;
+#ifdef __APPLE__
+    const auto& modified = info.st_mtimespec;
+#else
+    const auto& modified = info.st_mtim;
+#endif
+    out->modified = (int64_t)modified.tv_sec * 1000000000 + modified.tv_nsec;
+#endif
+    return true;
+}
+
+template <class Entry>
+struct file_cache_t {
+    struct cached_t {
+        file_stamp_t stamp;
+        Entry entry = {};
+        bool stamped = false;
+    };
+
+    std::unordered_map<std::string, std::string> canonical_paths;  // Paths as passed by scripts to canonical paths.
+    std::unordered_map<std::string, cached_t> entries;
+    vector<Entry> replaced;
+
+    // Entry of the file, reset if the file changed since it was cached. Returns nullptr if the file doesn't exist.
+    Entry* find(string_view filename) {
+        std::string path(filename.data(), filename.size());
+        file_stamp_t stamp;
+        if (!get_file_stamp(path.c_str(), &stamp)) return nullptr;
+
+        auto canonical = canonical_paths.find(path);
+        if (canonical == canonical_paths.end()) {
+            canonical = canonical_paths.emplace(path, canonical_path(path.c_str())).first;
+        }
+        auto& cached = entries[canonical->second];
+        if (!cached.stamped || cached.stamp != stamp) {
+            if (cached.stamped) replace(&cached.entry);
+            cached.stamp = stamp;
+            cached.stamped = true;
+        }
+        return &cached.entry;
+    }
+
+    // Resets entry, the previous contents stay alive until release_replaced.
+    void replace(Entry* entry) {
+        replaced.push_back(move(*entry));
+        *entry = {};
+    }
+
+    // Frees replaced entries, called once no value of the invocation is left.
+    void release_replaced() { replaced.clear(); }
+};
@@ -0,0 +1,49 @@
+/*
+Data files that were read while running, used to write a depfile for build systems (see --depfile).
+Scripts are already tracked in parsed_state_t::source_files, builtins that read files record them here.
+*/
+
+struct file_dependencies_t {
+    vector<string> data_files;
+
+    void add(string_view filename) {
+        auto it = find_if(data_files.begin(), data_files.end(),
+                          [filename](const string& entry) { return string_view{entry} == filename; });
+        if (it == data_files.end()) data_files.emplace_back(filename.data(), filename.size());
+    }
+};
+
+file_dependencies_t default_file_dependencies;
+thread_local file_dependencies_t* current_file_dependencies = &default_file_dependencies;
+
+void record_file_dependency(string_view filename) { current_file_dependencies->add(filename); }
+
+// Absolute path with symbolic links and relative components resolved, so that different spellings of the same path
+// compare equal. Files that don't exist yet, like output files, are resolved through their directory. Returns filename
+// unchanged if its directory doesn't exist either.
+std::string canonical_path(const char* filename) {
+#ifdef _WIN32
+    // _fullpath doesn't require the file to exist.
+    char buffer[_MAX_PATH];
+    if (_fullpath(buffer, filename, _MAX_PATH)) return buffer;
+#else
+    if (char* path = realpath(filename, nullptr)) {
+        std::string result = path;
+        free(path);
+        return result;
+    }
+    auto separator = strrchr(filename, '/');
+    auto name = separator ? separator + 1 : filename;
+    std::string directory = separator ? std::string(filename, (size_t)(separator - filename) + 1) : std::string(".");
+    if (*name && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+        if (char* path = realpath(directory.c_str(), nullptr)) {
+            std::string result = path;
+            free(path);
+            if (result.back() != '/') result += '/';
+            result += name;
+            return result;
+        }
+    }
+#endif
+    return filename;
+}
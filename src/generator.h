@@ -8,6 +8,9 @@ struct generator_t {
     int required_parameters = 0;
     literal_block_t body;
     int scope_index;
+    // Lowered body, only used when running with engine_vm. Filled on the first call (see lower_generator_to_bytecode),
+    // since library files usually define many more generators than a single invocation calls.
+    mutable vm_program_t program;
 
     int stack_size = 0;  // How many variables this generator uses on the stack.
     bool finalized = false;
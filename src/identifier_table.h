@@ -0,0 +1,131 @@
+/*
+Identifiers are interned at tokenize time, so that symbol lookups can compare integer ids instead of strings.
+Interned strings point into source file contents, which live in the monotonic allocator for the whole run.
+*/
+
+uint32_t hash_identifier(string_view str) {
+    // FNV-1a.
+    uint32_t hash = 2166136261u;
+    for (auto c : str) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct identifier_table_t {
+    vector<string_view> strings;  // Interned id to string.
+    vector<uint32_t> hashes;      // Interned id to hash of string.
+    vector<int> slots;            // Open addressing with linear probing, -1 means empty.
+
+    int intern(string_view str) {
+        auto hash = hash_identifier(str);
+        auto slot = find_slot(str, hash);
+        if (slot >= 0 && slots[slot] >= 0) return slots[slot];
+
+        // Keep load factor at or below one half.
+        if ((strings.size() + 1) * 2 > slots.size()) {
+            grow();
+            slot = find_slot(str, hash);
+        }
+        assert(slot >= 0 && slots[slot] < 0);
+
+        int id = (int)strings.size();
+        strings.push_back(str);
+        hashes.push_back(hash);
+        slots[slot] = id;
+        return id;
+    }
+
+    // Returns -1 if str was never interned, in which case no symbol can have that name.
+    int find(string_view str) const {
+        auto slot = find_slot(str, hash_identifier(str));
+        if (slot < 0) return -1;
+        return slots[slot];
+    }
+
+    string_view get(int id) const {
+        assert(is_valid_index(strings.size(), id));
+        return strings[id];
+    }
+
+   private:
+    // Returns the slot containing str or the empty slot where str would be inserted.
+    int find_slot(string_view str, uint32_t hash) const {
+        if (slots.empty()) return -1;
+        auto mask = slots.size() - 1;
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            auto id = slots[i];
+            if (id < 0 || (hashes[id] == hash && strings[id] == str)) return (int)i;
+        }
+    }
+
+    void grow() {
+        slots.assign(max<size_t>(slots.size() * 2, 64), -1);
+        auto mask = slots.size() - 1;
+        for (int id = 0, count = (int)strings.size(); id < count; ++id) {
+            auto i = hashes[id] & mask;
+            while (slots[i] >= 0) i = (i + 1) & mask;
+            slots[i] = id;
+        }
+    }
+};
+
+// Like default_allocator, each thread has its own default table. Parsed data binds the table it was created with
+// together with its allocator (see parsed_state_scope_t), since interned strings point into memory of that allocator.
+thread_local identifier_table_t default_identifiers;
+thread_local identifier_table_t* current_identifiers = &default_identifiers;
+
+// Binds identifiers to the calling thread while in scope, the previous table is restored afterwards.
+struct identifier_table_scope_t {
+    identifier_table_t* prev_identifiers;
+
+    explicit identifier_table_scope_t(identifier_table_t* identifiers) : prev_identifiers(current_identifiers) {
+        assert(identifiers);
+        current_identifiers = identifiers;
+    }
+    ~identifier_table_scope_t() { current_identifiers = prev_identifiers; }
+    identifier_table_scope_t(const identifier_table_scope_t&) = delete;
+    identifier_table_scope_t& operator=(const identifier_table_scope_t&) = delete;
+};
+
+// Used instead of current_identifiers while files are parsed concurrently (see parse_files). Identifiers the thread has
+// seen before are found without locking, only new ones are looked up in the shared table.
+struct identifier_cache_t {
+    identifier_table_t* shared = nullptr;
+    std::mutex* shared_mutex = nullptr;
+    identifier_table_t local;  // Local id to index into shared_ids.
+    vector<int> shared_ids;
+
+    int intern(string_view str) {
+        auto local_id = local.find(str);
+        if (local_id >= 0) return shared_ids[local_id];
+
+        int id = -1;
+        {
+            std::lock_guard<std::mutex> lock(*shared_mutex);
+            id = shared->intern(str);
+        }
+        local.intern(str);
+        shared_ids.push_back(id);
+        return id;
+    }
+    int find(string_view str) {
+        auto local_id = local.find(str);
+        if (local_id >= 0) return shared_ids[local_id];
+
+        std::lock_guard<std::mutex> lock(*shared_mutex);
+        return shared->find(str);
+    }
+};
+
+thread_local identifier_cache_t* current_identifier_cache = nullptr;
+
+int intern_identifier(string_view str) {
+    if (current_identifier_cache) return current_identifier_cache->intern(str);
+    return current_identifiers->intern(str);
+}
+int find_identifier(string_view str) {
+    if (current_identifier_cache) return current_identifier_cache->find(str);
+    return current_identifiers->find(str);
+}
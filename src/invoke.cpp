@@ -29,13 +29,13 @@ void output_spaces(std::string& stream, int spaces) {
 void output_preceding_newlines(output_context* out) {
     auto ws = &out->whitespace;
     if (ws->preceding_newlines > 0) {
-        output_newlines(out->stream, ws->preceding_newlines);
+        output_newlines(out->sink.buffer, ws->preceding_newlines);
         ws->preceding_newlines = 0;
     }
 }
 void output_preceding(output_context* out) {
     auto ws = &out->whitespace;
-    auto& stream = out->stream;
+    auto& stream = out->sink.buffer;
     if (ws->preceding_newlines > 0) {
         output_newlines(stream, ws->preceding_newlines);
         ws->preceding_newlines = 0;
@@ -52,12 +52,14 @@ void output_preceding(output_context* out) {
 
 void output_string(output_context* out, string_view str, int preceding_spaces) {
     output_preceding(out);
-    if (preceding_spaces > 0) output_spaces(out->stream, preceding_spaces);
-    out->stream.insert(out->stream.end(), str.begin(), str.end());
+    auto& stream = out->sink.buffer;
+    if (preceding_spaces > 0) output_spaces(stream, preceding_spaces);
+    stream.insert(stream.end(), str.begin(), str.end());
+    out->sink.flush_if_full();
 }
 
 void output_any(output_context* out, const any_t& value_ref, int preceding_spaces, const PrintFormat& format) {
-    auto& stream = out->stream;
+    auto& stream = out->sink.buffer;
 
     auto value = value_ref.dereference();
     auto type = value->get_type_info();
@@ -68,6 +70,7 @@ void output_any(output_context* out, const any_t& value_ref, int preceding_space
     }
 
     print(stream, "{}", format, *value);
+    out->sink.flush_if_full();
 }
 
 void output_expression(process_state_t* state, const expression_t* exp, int preceding_spaces,
@@ -75,10 +78,11 @@ void output_expression(process_state_t* state, const expression_t* exp, int prec
     // We add to preceding_spaces instead of outputting spaces ourselfes, because
     // evaluate_expression_or_null might call into a generator, in which case the spaces should not be added
     // just once, but for each added segment.
-    state->output.whitespace.spaces += preceding_spaces;
+    auto out = state->current_output();
+    out->whitespace.spaces += preceding_spaces;
     auto value = evaluate_expression_or_null(state, exp);
-    state->output.whitespace.spaces -= preceding_spaces;
-    output_any(&state->output, value, preceding_spaces, format);
+    out->whitespace.spaces -= preceding_spaces;
+    output_any(out, value, preceding_spaces, format);
 }
 
 struct eval_result {
@@ -90,7 +94,7 @@ eval_result evaluate_literal_body(process_state_t* state, const literal_block_t&
 eval_result evaluate_segment(process_state_t* state, const formatted_segment_t& segment) {
     eval_result result = {};
     auto& stack = state->value_stack;
-    auto out = &state->output;
+    auto out = state->current_output();
     auto ws = segment.whitespace;
     out->push_line(ws.preceding_newlines, ws.indentation, ws.spaces);
 
@@ -127,18 +131,24 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
                 assert(conversion_success);
 
                 auto prev_scope = state->current_symbol_table;
+                eval_result nested_result = {};
                 if (condition_value) {
                     // output_newlines(out);
                     assert(if_statement.then_block.valid);
                     state->set_scope(if_statement.then_scope_index);
-                    evaluate_literal_body(state, if_statement.then_block);
+                    nested_result = evaluate_literal_body(state, if_statement.then_block);
                 } else if (if_statement.else_block.valid) {
                     // output_newlines(out);
                     assert(if_statement.else_scope_index >= 0);
                     state->set_scope(if_statement.else_scope_index);
-                    evaluate_literal_body(state, if_statement.else_block);
+                    nested_result = evaluate_literal_body(state, if_statement.else_block);
                 }
                 state->set_scope(prev_scope);
+                // Break, continue and return inside of if bodies apply to the enclosing for statement/generator.
+                if (nested_result.type != eval_result::resume_result) {
+                    result = nested_result;
+                    goto end;
+                }
                 continue;
             }
             case stmt_for: {
@@ -152,19 +162,23 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
 
                 any_t container_ref = evaluate_expression_or_null(state, for_statement.container_expression.get());
                 auto container = container_ref.dereference();
-                auto symbol = state->find_symbol(for_statement.variable);
+                auto symbol = state->find_symbol(for_statement.variable_id);
                 assert(symbol);
                 if (container->is_array()) {
-                    auto& array = container->as_array();
+                    const auto& array = for_statement.mutable_elements ? container->pin_array() : container->as_array();
                     // if (array.size()) output_newlines(out);
                     auto array_size = (int)array.size();
                     out->nested_for_statements[block_index] = {true};
                     for (int i = 0; i < array_size; ++i) {
                         out->nested_for_statements[block_index].last = (i + 1 == array_size);
-                        stack.back().values[symbol->stack_value_index] = make_any_ref(&array[i]);
+                        stack.back().values[symbol->stack_value_index] = make_any_ref(const_cast<any_t*>(&array[i]));
+                        profile_iteration(state, &for_statement);
                         auto nested_result = evaluate_literal_body(state, body);
                         if (nested_result.type != eval_result::resume_result) {
-                            if (nested_result.type == eval_result::return_result) goto end;
+                            if (nested_result.type == eval_result::return_result) {
+                                result = nested_result;
+                                break;
+                            }
                             // If level is > 0 we have to break no matter what,
                             // since a statement like 'continue 1;' is a break and a continue.
                             if (nested_result.level > 0) {
@@ -182,11 +196,15 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
                         index_value = make_any(i);
                         out->nested_for_statements[block_index].last = (i + 1 == range.max);
                         stack.back().values[symbol->stack_value_index] = make_any_ref(&index_value);
+                        profile_iteration(state, &for_statement);
                         auto nested_result = evaluate_literal_body(state, body);
                         i = index_value.convert_to_int();  // Get back value from script.
 
                         if (nested_result.type != eval_result::resume_result) {
-                            if (nested_result.type == eval_result::return_result) goto end;
+                            if (nested_result.type == eval_result::return_result) {
+                                result = nested_result;
+                                break;
+                            }
                             // If level is > 0 we have to break no matter what,
                             // since a statement like 'continue 1;' is a break and a continue.
                             if (nested_result.level > 0) {
@@ -197,7 +215,7 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
                         }
                     }
                 } else if(is_custom_type(container->type)) {
-                    auto iterateble = container->as_custom()->to_iterateble();
+                    auto iterateble = container->custom_to_iterateble();
                     assert(iterateble);
                     out->nested_for_statements[block_index] = {true};
                     auto current = iterateble->next();
@@ -206,9 +224,13 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
                         out->nested_for_statements[block_index].last = (next.type.id == tid_undefined);
 
                         stack.back().values[symbol->stack_value_index] = make_any_ref(&current);
+                        profile_iteration(state, &for_statement);
                         auto nested_result = evaluate_literal_body(state, body);
                         if (nested_result.type != eval_result::resume_result) {
-                            if (nested_result.type == eval_result::return_result) goto end;
+                            if (nested_result.type == eval_result::return_result) {
+                                result = nested_result;
+                                break;
+                            }
                             // If level is > 0 we have to break no matter what,
                             // since a statement like 'continue 1;' is a break and a continue.
                             if (nested_result.level > 0) {
@@ -225,6 +247,28 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
 
                 out->nested_for_statements.pop_back();
                 state->set_scope(prev_scope);
+                // Statements following a for statement that was left by 'break n', 'continue n' or return are skipped.
+                if (result.type != eval_result::resume_result) goto end;
+                continue;
+            }
+            case stmt_output: {
+                const auto& output_statement = statement.output_statement;
+
+                auto path_ref = evaluate_expression_or_null(state, output_statement.path_expression.get());
+                auto path = path_ref.dereference();
+                // Error was already reported if path couldn't be evaluated.
+                if (!path->type.is(tid_string, 0)) continue;
+
+                auto prev_scope = state->set_scope(output_statement.scope_index);
+                state->enter_output_target(path->as_string());
+                auto nested_result = evaluate_literal_body(state, output_statement.body);
+                state->leave_output_target();
+                state->set_scope(prev_scope);
+                // Return inside of the body applies to the enclosing generator.
+                if (nested_result.type != eval_result::resume_result) {
+                    result = nested_result;
+                    goto end;
+                }
                 continue;
             }
             case stmt_expression: {
@@ -251,7 +295,7 @@ eval_result evaluate_segment(process_state_t* state, const formatted_segment_t&
             }
             case stmt_declaration: {
                 auto declaration = &statement.declaration;
-                auto symbol = state->find_symbol(declaration->variable.contents);
+                auto symbol = state->find_symbol(declaration->variable.identifier_id);
                 assert(symbol);
 
                 auto& stack_entry = stack.back().values[symbol->stack_value_index];
@@ -289,6 +333,9 @@ eval_result evaluate_literal_body(process_state_t* state, const literal_block_t&
     return result;
 }
 
+void vm_execute(process_state_t* state, const vm_program_t& program);
+void lower_generator_to_bytecode(process_state_t* state, const generator_t& generator);
+
 void evaluate_call(process_state_t* state, const generator_t& generator, const vector<unique_expression_t>& arguments) {
     assert(state);
     assert(generator.required_parameters >= 0);
@@ -348,7 +395,7 @@ void evaluate_call(process_state_t* state, const generator_t& generator, const v
                 std::find_if(generator.parameters.begin(), generator.parameters.end(), [identifier](const auto& param) {
                     return param.variable.contents == identifier->identifier;
                 }) != generator.parameters.end());
-            assert(symbol == state->find_symbol_flat(identifier->identifier, scope_index));
+            assert(symbol == state->find_symbol_flat(identifier->identifier_id, scope_index));
             MAYBE_UNUSED(symbol);
             assert(symbol);
             auto rhs = assign->rhs.get();
@@ -372,7 +419,7 @@ void evaluate_call(process_state_t* state, const generator_t& generator, const v
 
     for (int i = 0; i < count; ++i) {
         auto& param = generator.parameters[i];
-        auto symbol = state->find_symbol_flat(param.variable.contents, scope_index);
+        auto symbol = state->find_symbol_flat(param.variable.identifier_id, scope_index);
         assert(symbol);
         assert(symbol->stack_value_index == i);
 
@@ -395,10 +442,17 @@ void evaluate_call(process_state_t* state, const generator_t& generator, const v
     }
 
     // Actual invocation and evaluation happens in evaluate_literal_body.
+    profile_call_scope_t profile_scope{state, &generator};
     state->value_stack.push_back(std::move(current_stack));
     auto prev_scope_index = state->set_scope(scope_index);
-    evaluate_literal_body(state, generator.body);
-    if (state->output.whitespace.preceding_newlines) state->output.stream += '\n';
+    if (state->engine == engine_vm) {
+        if (generator.program.code.empty()) lower_generator_to_bytecode(state, generator);
+        vm_execute(state, generator.program);
+    } else {
+        evaluate_literal_body(state, generator.body);
+    }
+    auto out = state->current_output();
+    if (out->whitespace.preceding_newlines) out->sink.buffer += '\n';
 
     state->value_stack.pop_back();
     state->set_scope(prev_scope_index);
@@ -418,6 +472,15 @@ void invoke_toplevel(process_state_t* state, any_t argv) {
     assert(argv_symbol);
     current_stack.values[argv_symbol->stack_value_index] = move(argv);
 
-    evaluate_segment(state, data->toplevel_segment);
+    profile_call_scope_t profile_scope{state, nullptr};
+    if (state->engine == engine_vm) {
+        vm_execute(state, data->toplevel_program);
+    } else {
+        evaluate_segment(state, data->toplevel_segment);
+    }
     state->value_stack.pop_back();
+
+    // No value of the invocation is left that could point into documents or tables it replaced.
+    current_json_document_cache->release_replaced();
+    current_csv_table_cache->release_replaced();
 }
@@ -0,0 +1,435 @@
+struct vm_loop_t {
+    enum { loop_array, loop_range, loop_custom } kind;
+    size_t nested_for_index = 0;
+
+    any_t container;  // Keeps temporary containers alive while iterating.
+    int index = 0;
+    int end = 0;
+
+    any_t index_value;  // Value of the loop variable when iterating over a range, the script may modify it.
+
+    std::unique_ptr<custom_iterator_t> iterator;
+    any_t current;
+    any_t next;
+};
+
+int vm_to_int(const any_t& value_ref, const expression_t* exp) {
+    auto value = value_ref.dereference();
+    if (value->type.is(tid_int, 0)) return value->i;
+
+    int result = 0;
+    if (!value->try_convert_to_int(&result)) throw tg_exeption("Operation on non integer value.", exp->location);
+    return result;
+}
+bool vm_to_bool(const any_t& value_ref, const expression_t* exp) {
+    auto value = value_ref.dereference();
+    if (value->type.is(tid_bool, 0)) return value->b;
+
+    bool result = false;
+    if (!value->try_convert_to_bool(&result)) throw tg_exeption("Operation on non boolean value.", exp->location);
+    return result;
+}
+
+void vm_set_loop_variable(output_context* out, vm_loop_t* loop, any_t* variable) {
+    auto& last = out->nested_for_statements[loop->nested_for_index].last;
+    switch (loop->kind) {
+        case vm_loop_t::loop_array: {
+            last = (loop->index + 1 == loop->end);
+            // Entries are only written through if the loop pinned the array, see op_pin_array.
+            auto& array = loop->container.dereference()->as_array();
+            *variable = make_any_ref(const_cast<any_t*>(&array[loop->index]));
+            break;
+        }
+        case vm_loop_t::loop_range: {
+            last = (loop->index + 1 == loop->end);
+            loop->index_value = make_any(loop->index);
+            *variable = make_any_ref(&loop->index_value);
+            break;
+        }
+        case vm_loop_t::loop_custom: {
+            loop->next = loop->iterator->next();
+            last = (loop->next.type.id == tid_undefined);
+            *variable = make_any_ref(&loop->current);
+            break;
+        }
+    }
+}
+
+// Returns whether the loop variable holds a new value.
+bool vm_begin_loop(output_context* out, vm_loop_t* loop, any_t container_ref) {
+    loop->nested_for_index = out->nested_for_statements.size();
+    out->nested_for_statements.push_back({true});
+
+    loop->container = std::move(container_ref);
+    auto container = loop->container.dereference();
+    if (container->is_array()) {
+        loop->kind = vm_loop_t::loop_array;
+        loop->index = 0;
+        loop->end = (int)container->as_array().size();
+        return loop->index < loop->end;
+    }
+    if (container->type.is(tid_int_range, 0)) {
+        auto range = container->as_range();
+        loop->kind = vm_loop_t::loop_range;
+        loop->index = range.min;
+        loop->end = range.max;
+        return loop->index < loop->end;
+    }
+    if (is_custom_type(container->type)) {
+        loop->kind = vm_loop_t::loop_custom;
+        loop->iterator = container->custom_to_iterateble();
+        assert(loop->iterator);
+        loop->current = loop->iterator->next();
+        return loop->current.type.id != tid_undefined;
+    }
+    assert(0 && "For statement with wrong container type.");
+    return false;
+}
+
+bool vm_advance_loop(vm_loop_t* loop) {
+    switch (loop->kind) {
+        case vm_loop_t::loop_array: {
+            ++loop->index;
+            return loop->index < loop->end;
+        }
+        case vm_loop_t::loop_range: {
+            loop->index = loop->index_value.convert_to_int() + 1;  // Get back value from script.
+            return loop->index < loop->end;
+        }
+        case vm_loop_t::loop_custom: {
+            loop->current = move(loop->next);
+            return loop->current.type.id != tid_undefined;
+        }
+    }
+    return false;
+}
+
+void vm_end_loop(output_context* out, vm_loop_t* loop) {
+    assert(out->nested_for_statements.size() == loop->nested_for_index + 1);
+    out->nested_for_statements.pop_back();
+    loop->container = {};
+    loop->iterator.reset();
+    loop->current = {};
+    loop->next = {};
+}
+
+struct vm_frame_t {
+    const vm_program_t* program;
+    any_t* locals;
+    vector<any_t> operands;
+    vector<vm_loop_t> loops;
+};
+
+// Runs until op_return. Throws tg_exeption on runtime errors, *pc is the faulting instruction.
+void vm_run(process_state_t* state, vm_frame_t* frame, int* pc) {
+    auto out = state->current_output();
+    auto program = frame->program;
+    auto code = program->code.data();
+    auto locals = frame->locals;
+    auto& operands = frame->operands;
+
+    for (;;) {
+        const auto& instruction = code[*pc];
+        ++*pc;
+        switch (instruction.op) {
+            case op_push_line: {
+                out->push_line(instruction.a, instruction.b, instruction.c);
+                break;
+            }
+            case op_pop_line: {
+                out->pop_line(instruction.b, instruction.c);
+                break;
+            }
+            case op_output_literal: {
+                output_string(out, program->literals[instruction.a], instruction.b);
+                break;
+            }
+            case op_output_comma: {
+                auto index = (size_t)instruction.a;
+                auto& nested = out->nested_for_statements;
+                assert(index < nested.size());
+                bool not_last = false;
+                for (auto i = index, count = nested.size(); i < count; ++i) {
+                    not_last = not_last || !nested[i].last;
+                }
+                if (not_last) output_string(out, (instruction.b) ? ", " : ",", instruction.c);
+                break;
+            }
+            case op_begin_output: {
+                // See output_expression.
+                out->whitespace.spaces += instruction.a;
+                break;
+            }
+            case op_output_value: {
+                out->whitespace.spaces -= instruction.b;
+                output_any(out, operands.back(), instruction.b, program->formats[instruction.a]);
+                operands.pop_back();
+                break;
+            }
+            case op_enter_output_target: {
+                auto path = operands.back().dereference();
+                if (path->type.is(tid_string, 0)) {
+                    state->enter_output_target(path->as_string());
+                    out = state->current_output();
+                } else {
+                    // Error was already reported if path couldn't be evaluated.
+                    *pc = instruction.a;
+                }
+                operands.pop_back();
+                break;
+            }
+            case op_leave_output_target: {
+                state->leave_output_target();
+                out = state->current_output();
+                break;
+            }
+
+            case op_jump: {
+                *pc = instruction.a;
+                break;
+            }
+            case op_jump_if_false: {
+                auto condition = operands.back().dereference();
+                assert(condition->type.id != tid_undefined);
+                bool condition_value = false;
+                bool conversion_success = condition->try_convert_to_bool(&condition_value);
+                MAYBE_UNUSED(conversion_success);
+                assert(conversion_success);
+                operands.pop_back();
+                if (!condition_value) *pc = instruction.a;
+                break;
+            }
+            case op_jump_if_false_keep:
+            case op_jump_if_true_keep: {
+                // Value was converted by op_to_bool.
+                bool jump_value = (instruction.op == op_jump_if_true_keep);
+                if (operands.back().as_bool() == jump_value) {
+                    *pc = instruction.a;
+                } else {
+                    operands.pop_back();
+                }
+                break;
+            }
+            case op_pin_array: {
+                auto container = operands.back().dereference();
+                if (container->is_array()) container->pin_array();
+                break;
+            }
+            case op_for_begin: {
+                auto loop = &frame->loops[instruction.a];
+                any_t container = std::move(operands.back());
+                operands.pop_back();
+                if (vm_begin_loop(out, loop, std::move(container))) {
+                    vm_set_loop_variable(out, loop, &locals[instruction.b]);
+                } else {
+                    *pc = instruction.c;
+                }
+                break;
+            }
+            case op_for_next: {
+                auto loop = &frame->loops[instruction.a];
+                if (vm_advance_loop(loop)) {
+                    vm_set_loop_variable(out, loop, &locals[instruction.b]);
+                    *pc = instruction.c;
+                }
+                break;
+            }
+            case op_for_end: {
+                vm_end_loop(out, &frame->loops[instruction.a]);
+                break;
+            }
+            case op_profile_iteration: {
+                profile_iteration(state, program->for_statements[instruction.a]);
+                break;
+            }
+            case op_return: {
+                assert(operands.empty());
+                return;
+            }
+
+            case op_load_local: {
+                operands.push_back(make_any_ref(&locals[instruction.a]));
+                break;
+            }
+            case op_store_local: {
+                locals[instruction.a] = std::move(operands.back());
+                operands.pop_back();
+                break;
+            }
+            case op_init_local: {
+                locals[instruction.a].set_type({(typeid_enum_underlying)instruction.b, (int16_t)instruction.c});
+                break;
+            }
+
+            case op_push_int: {
+                operands.push_back(make_any(instruction.a));
+                break;
+            }
+            case op_push_bool: {
+                operands.push_back(make_any(instruction.a != 0));
+                break;
+            }
+            case op_push_constant: {
+                operands.push_back(program->constants[instruction.a]);
+                break;
+            }
+            case op_make_array: {
+                auto exp = program->expressions[instruction.a];
+                auto first = operands.end() - instruction.b;
+                vector<any_t> array{std::make_move_iterator(first), std::make_move_iterator(operands.end())};
+                operands.erase(first, operands.end());
+                operands.push_back(make_any(std::move(array), exp->result_type));
+                break;
+            }
+            case op_eval_expression: {
+                operands.push_back(evaluate_expression_throws(state, program->expressions[instruction.a]));
+                break;
+            }
+
+            case op_to_bool: {
+                auto& value = operands.back();
+                value = make_any(vm_to_bool(value, program->expressions[instruction.a]));
+                break;
+            }
+            case op_to_int: {
+                auto& value = operands.back();
+                value = make_any(vm_to_int(value, program->expressions[instruction.a]));
+                break;
+            }
+            case op_not: {
+                auto& value = operands.back();
+                value = make_any(!vm_to_bool(value, program->expressions[instruction.a]));
+                break;
+            }
+            case op_negate: {
+                auto& value = operands.back();
+                value = make_any(-vm_to_int(value, program->expressions[instruction.a]));
+                break;
+            }
+
+#define VM_INT_BINARY_OP(opcode, operation)                                  \
+    case opcode: {                                                           \
+        auto exp = program->expressions[instruction.a];                      \
+        auto count = operands.size();                                        \
+        int lhs = vm_to_int(operands[count - 2], exp);                       \
+        int rhs = vm_to_int(operands[count - 1], exp);                       \
+        operands.pop_back();                                                 \
+        operands.back() = make_any(operation);                               \
+        break;                                                               \
+    }
+                VM_INT_BINARY_OP(op_mul, lhs * rhs)
+                VM_INT_BINARY_OP(op_div, lhs / rhs)
+                VM_INT_BINARY_OP(op_mod, lhs % rhs)
+                VM_INT_BINARY_OP(op_add, lhs + rhs)
+                VM_INT_BINARY_OP(op_sub, lhs - rhs)
+                VM_INT_BINARY_OP(op_lt, lhs < rhs)
+                VM_INT_BINARY_OP(op_lte, lhs <= rhs)
+                VM_INT_BINARY_OP(op_gt, lhs > rhs)
+                VM_INT_BINARY_OP(op_gte, lhs >= rhs)
+                VM_INT_BINARY_OP(op_eq_int, (lhs == rhs) != (instruction.b != 0))
+#undef VM_INT_BINARY_OP
+
+            case op_eq_string: {
+                auto count = operands.size();
+                auto lhs = operands[count - 2].dereference()->as_string();
+                auto rhs = operands[count - 1].dereference()->as_string();
+                bool result = (lhs == rhs) != (instruction.b != 0);
+                operands.pop_back();
+                operands.back() = make_any(result);
+                break;
+            }
+            case op_eq: {
+                auto count = operands.size();
+                bool result = (operands[count - 2] == operands[count - 1]) != (instruction.b != 0);
+                operands.pop_back();
+                operands.back() = make_any(result);
+                break;
+            }
+
+            case op_subscript: {
+                auto exp = static_cast<const expression_subscript_t*>(program->expressions[instruction.a]);
+                auto count = operands.size();
+                any_t result = evaluate_subscript(state, exp, operands[count - 2], operands[count - 1]);
+                operands.pop_back();
+                operands.back() = std::move(result);
+                break;
+            }
+            case op_dot: {
+                auto exp = static_cast<const expression_dot_t*>(program->expressions[instruction.a]);
+                auto& value = operands.back();
+                value = evaluate_dot_fields(exp, std::move(value));
+                break;
+            }
+            case op_assign: {
+                auto count = operands.size();
+                assign_value(operands[count - 2].dereference(), operands[count - 1].dereference());
+                operands.pop_back();
+                operands.back() = make_any_void();
+                break;
+            }
+            case op_call_function: {
+                auto exp = static_cast<const expression_call_t*>(program->expressions[instruction.a]);
+                auto callee = operands.end() - instruction.b - 1;
+                auto function = callee->dereference()->as_function();
+                array_view<any_t> arguments = {&*callee + 1, (size_t)instruction.b};
+                any_t result = call_builtin(state, exp, function, arguments);
+                operands.erase(callee, operands.end());
+                operands.push_back(std::move(result));
+                break;
+            }
+            case op_call_method: {
+                auto exp = static_cast<const expression_call_t*>(program->expressions[instruction.a]);
+                auto this_ref = operands.end() - instruction.b - 1;
+                // Methods get a reference to this, temporaries are kept alive here while the method is called.
+                any_t this_value;
+                if (!this_ref->type.is(tid_reference, 0)) {
+                    this_value = std::move(*this_ref);
+                    *this_ref = make_any_ref(&this_value);
+                }
+                array_view<any_t> arguments = {&*this_ref, (size_t)instruction.b + 1};
+                any_t result = call_builtin(state, exp, exp->method, arguments);
+                operands.erase(this_ref, operands.end());
+                operands.push_back(std::move(result));
+                break;
+            }
+            case op_call_generator: {
+                auto exp = static_cast<const expression_call_t*>(program->expressions[instruction.a]);
+                auto generator = operands.back().dereference()->as_generator();
+                evaluate_call(state, *generator, exp->arguments);
+                operands.back() = make_any_void();
+                break;
+            }
+        }
+    }
+}
+
+void vm_execute(process_state_t* state, const vm_program_t& program) {
+    assert(!program.code.empty());
+    vm_frame_t frame = {&program, state->value_stack.back().values.data()};
+    frame.operands.reserve(program.max_operands);
+    frame.loops.resize(program.loop_slots);
+
+    int pc = 0;
+    for (;;) {
+        try {
+            vm_run(state, &frame, &pc);
+            return;
+        } catch (tg_exeption ex) {
+            if (ex.message) print_error_context(ex.message, {state->data->source_files, ex.location});
+
+            // Resume after the faulting expression with an undefined value, see evaluate_expression_or_null.
+            auto faulting = pc - 1;
+            auto& ranges = program.expression_ranges;
+            auto range = std::upper_bound(ranges.begin(), ranges.end(), faulting,
+                                          [](int value, const vm_expression_range_t& entry) {
+                                              return value < entry.first;
+                                          });
+            assert(range != ranges.begin());
+            --range;
+            assert(faulting >= range->first && faulting < range->last);
+            frame.operands.clear();
+            frame.operands.emplace_back();
+            pc = range->last;
+        }
+    }
+}
@@ -1,20 +1,93 @@
 // Wrap all types that we want to expose to the language.
-enum json_extension_types : typeid_enum_underlying { tid_json_document = tid_custom, tid_json_value };
+enum json_extension_types : typeid_enum_underlying { tid_json_document = tid_custom, tid_json_value, tid_json_lines };
 
-struct wrapped_json_document final : custom_base_t {
-    JsonAllocatedDocument doc;
-    tmu_contents json_file_contents;
-
-    wrapped_json_document() = default;
-    explicit wrapped_json_document(JsonAllocatedDocument doc, tmu_contents json_file_contents)
-        : doc(doc), json_file_contents(json_file_contents) {}
+// Parsed document together with the file contents it points into.
+struct json_document_t {
+    JsonAllocatedDocument doc = {};
+    tmu_contents json_file_contents = {};
 
-    virtual ~wrapped_json_document() override {
+    json_document_t() = default;
+    json_document_t(const json_document_t&) = delete;
+    json_document_t& operator=(const json_document_t&) = delete;
+    ~json_document_t() {
         jsonFreeDocument(&doc);
         tmu_destroy_contents(&json_file_contents);
     }
+};
+
+const JsonValue* json_find_member(JsonObject object, string_view key) {
+    for (size_t i = 0; i < object.count; ++i) {
+        auto& node = object.nodes[i];
+        if (string_view{node.name.data, node.name.size} == key) return &node.value;
+    }
+    return nullptr;
+}
+
+/*
+Documents that were read while running, so that scripts reading the same file repeatedly only parse it once (see
+file_cache_t). Documents are kept alive until the cache is destroyed, which happens after all values are destroyed.
+Replaced documents are kept until the end of the invocation that replaced them. That is why json_value and strings read
+from documents can point into documents without owning them.
+*/
+struct json_document_cache_t {
+    struct entry_t {
+        std::shared_ptr<const json_document_t> document;
+        std::shared_ptr<lazy_json_document_t> lazy;
+    };
+
+    file_cache_t<entry_t> files;
+
+    // Lookup indices of eager documents, see json_index.h. Arrays and objects are identified by address, which is
+    // unique since documents are never freed while the cache is alive.
+    json_find_indices_t find_indices;
+    std::unordered_map<const JsonObjectNode*, json_object_index_t<const JsonValue*>> object_indices;
+
+    // Entry of the file, reset if the file changed since it was cached. Returns nullptr if the file doesn't exist.
+    entry_t* find(string_view filename) { return files.find(filename); }
+
+    // Frees replaced documents, called once no value of the invocation is left. Lookup indices are keyed by address
+    // and freed addresses can be reused by later documents, so all indices are dropped and rebuilt on demand.
+    void release_replaced() {
+        if (files.replaced.empty()) return;
+        files.release_replaced();
+        find_indices = {};
+        object_indices.clear();
+    }
+
+    // Value of an object by key, nullptr if there is none. Large objects are indexed on first access.
+    const JsonValue* find_member(JsonObject object, string_view key) {
+        if (object.count < json_object_index_min_members) return json_find_member(object, key);
+
+        auto& index = object_indices[object.nodes];
+        if (index.empty()) {
+            // Keep the first of duplicate keys, like the linear search.
+            for (size_t i = 0; i < object.count; ++i) {
+                auto& node = object.nodes[i];
+                index.emplace(string_view{node.name.data, node.name.size}, &node.value);
+            }
+        }
+        auto it = index.find(key);
+        return (it != index.end()) ? it->second : nullptr;
+    }
+};
+
+json_document_cache_t default_json_document_cache;
+thread_local json_document_cache_t* current_json_document_cache = &default_json_document_cache;
+
+struct wrapped_json_document final : custom_base_t {
+    std::shared_ptr<const json_document_t> document;
+    // Set instead of document for documents read with read_json_document_lazy.
+    std::shared_ptr<lazy_json_document_t> lazy;
+
+    wrapped_json_document() = default;
+    virtual ~wrapped_json_document() override {}
 
-    virtual custom_base_t* clone() const override { return new wrapped_json_document{doc, json_file_contents}; }
+    virtual custom_base_t* clone() const override {
+        auto result = new wrapped_json_document();
+        result->document = document;
+        result->lazy = lazy;
+        return result;
+    }
     virtual typeid_info type() const override { return {tid_json_document, 0}; }
 
     // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
@@ -27,14 +100,184 @@ struct wrapped_json_document final : custom_base_t {
     }
 };
 
-struct wrapped_json_array_iterator final : custom_iterator_t {
-    JsonValue* first;
-    JsonValue* last;
+// One record of read_json_lines. Records aren't cached, they are freed once no json_value refers to them anymore.
+struct json_record_t {
+    std::string text;
+    JsonAllocatedDocument doc = {};
+
+    json_record_t() = default;
+    json_record_t(const json_record_t&) = delete;
+    json_record_t& operator=(const json_record_t&) = delete;
+    ~json_record_t() { jsonFreeDocument(&doc); }
+};
+
+// Value inside of a record, owned by the any_t it is stored in.
+struct json_record_value_t {
+    std::shared_ptr<const json_record_t> record;
+    const JsonValue* value;
+};
+
+/*
+json_value is stored inline in any_t::data (see custom_inline_type_t), so that traversing documents doesn't allocate.
+Values of eager documents point to their JsonValue in the document, values of lazy documents to their node with the
+lowest bit set. Missing values are null and behave like a default constructed JsonValue.
+Values of records (see read_json_lines) can't point into the document cache, they point to a json_record_value_t with
+the second lowest bit set, which keeps the record alive.
+*/
+struct json_value_t {
+    const JsonValue* value = nullptr;
+    lazy_json_node_t* node = nullptr;               // Set instead of value for values of lazy documents.
+    const json_record_value_t* record = nullptr;  // Set in addition to value for values of records.
+
+    JsonValue get() const { return value ? *value : JsonValue{}; }
+};
+
+constexpr uintptr_t json_value_lazy_bit = 1;
+constexpr uintptr_t json_value_record_bit = 2;
+
+json_value_t to_json_value(const any_t& any) {
+    assert(any.type.is(tid_json_value, 0));
+    auto bits = (uintptr_t)any.data;
+    if (bits & json_value_lazy_bit) return {nullptr, (lazy_json_node_t*)(bits & ~json_value_lazy_bit)};
+    if (bits & json_value_record_bit) {
+        auto record = (const json_record_value_t*)(bits & ~json_value_record_bit);
+        return {record->value, nullptr, record};
+    }
+    return {(const JsonValue*)bits, nullptr};
+}
+
+any_t make_any_json_value(const JsonValue* value) {
+    assert(((uintptr_t)value & (json_value_lazy_bit | json_value_record_bit)) == 0);
+    return make_any_custom_inline({tid_json_value, 0}, (void*)value);
+}
+any_t make_any_json_value(lazy_json_node_t* node) {
+    if (!node) return make_any_custom_inline({tid_json_value, 0}, nullptr);
+    assert(((uintptr_t)node & (json_value_lazy_bit | json_value_record_bit)) == 0);
+    return make_any_custom_inline({tid_json_value, 0}, (void*)((uintptr_t)node | json_value_lazy_bit));
+}
+any_t make_any_json_value(std::shared_ptr<const json_record_t> record, const JsonValue* value) {
+    if (!record || !value) return make_any_json_value(value);
+    ++value_allocations.payloads;
+    auto data = new json_record_value_t{move(record), value};
+    return make_any_custom_inline({tid_json_value, 0}, (void*)((uintptr_t)data | json_value_record_bit));
+}
+// Value inside of an eager document or record, json is the value it was read from.
+any_t make_any_json_value(const json_value_t& json, const JsonValue* value) {
+    if (json.record) return make_any_json_value(json.record->record, value);
+    return make_any_json_value(value);
+}
+
+struct json_array_iterator final : custom_iterator_t {
+    const JsonValue* first;
+    const JsonValue* last;
+    std::shared_ptr<const json_record_t> record;  // Set if the array is part of a record.
+
+    json_array_iterator(JsonArray array, std::shared_ptr<const json_record_t> record)
+        : first(begin(array)), last(end(array)), record(move(record)) {}
+
+    virtual ~json_array_iterator() override{};
+    virtual any_t next() override {
+        if (first >= last) return {};
+        return make_any_json_value(record, first++);
+    }
+};
+
+struct lazy_json_array_iterator final : custom_iterator_t {
+    const lazy_json_member_t* first;
+    const lazy_json_member_t* last;
+
+    explicit lazy_json_array_iterator(const vector<lazy_json_member_t>& elements)
+        : first(elements.data()), last(elements.data() + elements.size()) {}
+
+    virtual ~lazy_json_array_iterator() override{};
+    virtual any_t next() override {
+        if (first >= last) return {};
+        return make_any_json_value((first++)->value);
+    }
+};
+
+/*
+Records of a JSON Lines file, one JSON value per line, see read_json_lines. The file is read in fixed size chunks and
+each record is parsed into its own document when it is reached, so memory doesn't grow with the size of the file.
+Empty lines are skipped, lines that aren't valid JSON are returned as missing values.
+*/
+struct json_lines_iterator final : custom_iterator_t {
+    FILE* file = nullptr;
+    size_t first = 0;
+    size_t last = 0;
+    char buffer[64 * 1024];
+
+    explicit json_lines_iterator(const std::string& filename) {
+        if (!filename.empty()) file = tmu_fopen(filename.c_str(), "rb");
+    }
+    virtual ~json_lines_iterator() override {
+        if (file) fclose(file);
+    }
+
+    // Reads the next line without the line break into line, returns false at the end of the file.
+    bool read_line(std::string* line) {
+        line->clear();
+        for (;;) {
+            if (first == last) {
+                if (file) {
+                    first = 0;
+                    last = fread(buffer, 1, sizeof(buffer), file);
+                }
+                if (first == last) {
+                    if (file) fclose(file);
+                    file = nullptr;
+                    return !line->empty();
+                }
+            }
+            const char* begin = buffer + first;
+            auto newline = (const char*)memchr(begin, '\n', last - first);
+            const char* end = newline ? newline : buffer + last;
+            line->append(begin, end);
+            first = newline ? (size_t)(newline - buffer) + 1 : last;
+            if (newline) return true;
+        }
+    }
+
+    virtual any_t next() override {
+        auto record = std::make_shared<json_record_t>();
+        for (;;) {
+            if (!read_line(&record->text)) return {};
+            auto& text = record->text;
+            while (!text.empty() && isspace((unsigned char)text.back())) text.pop_back();
+            if (!text.empty()) break;
+        }
+        record->doc = jsonAllocateDocument(record->text.data(), record->text.size(), JSON_READER_STRICT);
+        if (record->doc.document.error.type != JSON_OK) return make_any_json_value((const JsonValue*)nullptr);
+        auto root = &record->doc.document.root;
+        return make_any_json_value(move(record), root);
+    }
+};
+
+struct wrapped_json_lines final : custom_base_t {
+    std::string filename;  // Empty if the file couldn't be opened, iterating yields no records then.
 
-    explicit wrapped_json_array_iterator(JsonArray array) : first(begin(array)), last(end(array)) {}
+    wrapped_json_lines() = default;
+    virtual ~wrapped_json_lines() override {}
+
+    virtual custom_base_t* clone() const override {
+        auto result = new wrapped_json_lines();
+        result->filename = filename;
+        return result;
+    }
+    virtual typeid_info type() const override { return {tid_json_lines, 0}; }
 
-    virtual ~wrapped_json_array_iterator() override{};
-    virtual any_t next() override;
+    // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
+    virtual int print_to_string(char* buffer, size_t buffer_len, const tml::PrintFormat& initial) const override {
+        MAYBE_UNUSED(buffer);
+        MAYBE_UNUSED(buffer_len);
+        MAYBE_UNUSED(initial);
+        return -1;
+    }
+
+    // The file is read again every time the records are iterated.
+    virtual std::unique_ptr<custom_iterator_t> to_iterateble() const override {
+        return std::make_unique<json_lines_iterator>(filename);
+    }
 };
 
 int print_json_value(char* buffer, size_t buffer_len, const tml::PrintFormat& initial, JsonValue value) {
@@ -117,31 +360,84 @@ int print_json_value(char* buffer, size_t buffer_len, const tml::PrintFormat& in
     }
 }
 
-struct wrapped_json_value final : custom_base_t {
-    JsonValue value = {};
-
-    wrapped_json_value() = default;
-    explicit wrapped_json_value(JsonValue value) : value(value) {}
-    virtual ~wrapped_json_value() override {}
+// Same output as print_json_value for values of lazy documents.
+int print_lazy_json_value(char* buffer, size_t buffer_len, const tml::PrintFormat& initial, lazy_json_node_t* node) {
+    auto document = node->document;
+    switch (node->type) {
+        case JVAL_STRING: {
+            return ::tml::snprint(buffer, buffer_len, "{}", initial, document->string_value(node));
+        }
+        case JVAL_OBJECT:
+        case JVAL_ARRAY: {
+            bool is_object = (node->type == JVAL_OBJECT);
+            char* p = buffer;
+            char* last = buffer + buffer_len;
+            if ((last - p) < 1) return -1;
+            *p++ = is_object ? '{' : '[';
+            bool first = true;
+            for (auto& member : document->members(node)) {
+                if (!first) {
+                    if ((last - p) < 2) return -1;
+                    *p++ = ',';
+                    *p++ = ' ';
+                }
+                first = false;
+                auto remaining = (size_t)(last - p);
+                if (is_object) {
+                    auto print_result = tml::snprint(p, remaining, "\"{}\": ", member.name);
+                    if (print_result < 0 || (size_t)print_result >= remaining) return -1;
+                    p += print_result;
+                    remaining = (size_t)(last - p);
+                }
+                auto result = print_lazy_json_value(p, remaining, initial, member.value);
+                if (result < 0 || (size_t)result >= remaining) return -1;
+                p += result;
+            }
+            if ((last - p) < 1) return -1;
+            *p++ = is_object ? '}' : ']';
+            return (int)(p - buffer);
+        }
+        default: {
+            // Numbers, booleans and null are printed as written.
+            return ::tml::snprint(buffer, buffer_len, "{}", initial,
+                                  string_view{node->first, (size_t)(node->last - node->first)});
+        }
+    }
+}
 
-    virtual custom_base_t* clone() const override { return new wrapped_json_value{value}; }
-    virtual typeid_info type() const override { return {tid_json_value, 0}; }
+int json_value_print_to_string(const any_t& value, char* buffer, size_t buffer_len, const tml::PrintFormat& initial) {
+    auto json = to_json_value(value);
+    if (json.node) return print_lazy_json_value(buffer, buffer_len, initial, json.node);
+    return print_json_value(buffer, buffer_len, initial, json.get());
+}
 
-    // Should return -1 on error, required size if buffer_len is not enough and written amount on success.
-    virtual int print_to_string(char* buffer, size_t buffer_len, const tml::PrintFormat& initial) const override {
-        return print_json_value(buffer, buffer_len, initial, value);
+std::unique_ptr<custom_iterator_t> json_value_to_iterateble(const any_t& value) {
+    auto json = to_json_value(value);
+    if (json.node) {
+        static const vector<lazy_json_member_t> empty;
+        bool is_array = (json.node->type == JVAL_ARRAY);
+        return std::make_unique<lazy_json_array_iterator>(is_array ? json.node->document->members(json.node) : empty);
     }
+    return std::make_unique<json_array_iterator>(json.get().getArray(), json.record ? json.record->record : nullptr);
+}
 
-    virtual std::unique_ptr<custom_iterator_t> to_iterateble() const {
-        return std::make_unique<wrapped_json_array_iterator>(value.getArray());
-    }
-};
+// Only values of records own data, see json_value_t.
+void* json_value_copy(void* data) {
+    auto bits = (uintptr_t)data;
+    if (!(bits & json_value_record_bit)) return data;
+    ++value_allocations.payloads;
+    auto copy = new json_record_value_t(*(const json_record_value_t*)(bits & ~json_value_record_bit));
+    return (void*)((uintptr_t)copy | json_value_record_bit);
+}
+void json_value_destroy(void* data) {
+    auto bits = (uintptr_t)data;
+    if (bits & json_value_record_bit) delete (json_record_value_t*)(bits & ~json_value_record_bit);
+}
 
-any_t wrapped_json_array_iterator::next() {
-    if (first >= last) return {};
-    auto inner = new wrapped_json_value(*first);
-    ++first;
-    return make_any_custom(inner);
+const custom_inline_type_t* find_custom_inline_type(typeid_enum_underlying id) {
+    static const custom_inline_type_t json_value_type = {json_value_print_to_string, json_value_to_iterateble,
+                                                         json_value_copy, json_value_destroy};
+    return (id == tid_json_value) ? &json_value_type : nullptr;
 }
 
 builtin_arguments_valid_result_t read_json_document_check(const builtin_state_t& /*state*/,
@@ -154,20 +450,47 @@ builtin_arguments_valid_result_t read_json_document_check(const builtin_state_t&
     }
     return result;
 }
+std::shared_ptr<const json_document_t> read_json_document(const char* filename) {
+    auto file = tmu_read_file_as_utf8(filename);
+    if (file.ec != TM_OK) return nullptr;
+    auto document = std::make_shared<json_document_t>();
+    document->json_file_contents = file.contents;
+    document->doc = jsonAllocateDocument(file.contents.data, file.contents.size, JSON_READER_STRICT);
+    if (document->doc.document.error.type != JSON_OK) return nullptr;
+    return document;
+}
+
 any_t read_json_document_call(array_view<any_t> arguments) {
     auto inner = new wrapped_json_document();
 
     assert(arguments.size() == 1);
-    auto& str = arguments[0].dereference()->as_string();
-    auto file = tmu_read_file_as_utf8(str.c_str());
-    if (file.ec == TM_OK) {
-        auto allocated = jsonAllocateDocument(file.contents.data, file.contents.size, JSON_READER_STRICT);
-        if (allocated.document.error.type != JSON_OK) {
-            jsonFreeDocument(&allocated);
-            tmu_destroy_contents(&file.contents);
-        } else {
-            inner->doc = allocated;
-            inner->json_file_contents = file.contents;
+    string buffer;
+    auto str = arguments[0].dereference()->as_c_string(&buffer);
+    if (auto entry = current_json_document_cache->find(str)) {
+        if (!entry->document) entry->document = read_json_document(str.data());
+        if (entry->document) {
+            record_file_dependency(str);
+            inner->document = entry->document;
+        }
+    }
+
+    return make_any_custom(inner);
+}
+
+any_t read_json_document_lazy_call(array_view<any_t> arguments) {
+    auto inner = new wrapped_json_document();
+
+    assert(arguments.size() == 1);
+    string buffer;
+    auto str = arguments[0].dereference()->as_c_string(&buffer);
+    if (auto entry = current_json_document_cache->find(str)) {
+        if (!entry->lazy) {
+            auto document = std::make_shared<lazy_json_document_t>();
+            if (document->open(str.data())) entry->lazy = move(document);
+        }
+        if (entry->lazy) {
+            record_file_dependency(str);
+            inner->lazy = entry->lazy;
         }
     }
 
@@ -186,44 +509,48 @@ builtin_arguments_valid_result_t json_no_arg_check(const builtin_state_t& /*stat
 
 any_t json_exists_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    assert(lhs->type.is(tid_json_value, 0));
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any(json->value.type != JVAL_NULL || json->value.data.content.data != nullptr);
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) return make_any(true);
+    auto value = json.get();
+    return make_any(value.type != JVAL_NULL || value.data.content.data != nullptr);
 }
 template <int JVAL>
 any_t json_value_is_type_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    assert(lhs->type.is(tid_json_value, 0));
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any(json->value.type == JVAL);
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) return make_any(json.node->type == JVAL);
+    return make_any(json.get().type == JVAL);
 }
 
 any_t json_value_size_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any((int)json->value.getArray().count);
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) {
+        if (json.node->type != JVAL_ARRAY) return make_any(0);
+        return make_any((int)json.node->document->members(json.node).size());
+    }
+    return make_any((int)json.get().getArray().count);
 }
 
 any_t json_value_to_int_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any(json->value.getInt());
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) return make_any(lazy_json_to_int(json.node));
+    return make_any(json.get().getInt());
 }
 any_t json_value_to_bool_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any(json->value.getBool());
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) return make_any(lazy_json_to_bool(json.node));
+    return make_any(json.get().getBool());
 }
+// Strings are borrowed from the document, see json_document_cache_t. Records may be freed, so their strings are copied.
 any_t json_value_to_string_call(array_view<any_t> arguments) {
     assert(arguments.size() == 1);
-    auto lhs = arguments[0].dereference();
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-    return make_any(json->value.getString());
+    auto json = to_json_value(*arguments[0].dereference());
+    if (json.node) return make_any_borrowed(json.node->document->string_value(json.node));
+    if (json.record) return make_any(string_view{json.get().getString()});
+    return make_any_borrowed(json.get().getString());
 }
 
 // find_object
@@ -247,62 +574,145 @@ builtin_arguments_valid_result_t json_find_object_check(const builtin_state_t& /
     return result;
 }
 
-any_t json_find_object_call(array_view<any_t> arguments) {
-    assert(arguments.size() == 3);
-    auto lhs = arguments[0].dereference();
-    assert(lhs->type.is(tid_json_value, 0));
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
-
-    auto inner = new wrapped_json_value{};
-
-    auto array = json->value.getArray();
-    if (!array) return make_any_custom(inner);
-
-    string_view key = arguments[1].dereference()->as_string();
-    auto value_base = arguments[2].dereference();
-
-    switch (value_base->type.id) {
-        case tid_int: {
-            auto value = value_base->as_int();
-            for (auto& entry : array) {
-                auto obj = entry.getObject();
-                auto json_value = obj[key];
-                if (json_value.isIntegral() && json_value.getInt() == value) {
-                    inner->value = entry;
+lazy_json_node_t* lazy_json_find_object(lazy_json_node_t* node, string_view key, const any_t* value_base) {
+    if (!node || node->type != JVAL_ARRAY) return nullptr;
+    auto document = node->document;
+    auto& entries = document->members(node);
+
+    auto value_type = value_base->type.id;
+    auto index = document->find_indices.find(node, key, value_type);
+    if (!index) {
+        auto new_index = document->find_indices.add(node, key, value_type);
+        for (size_t i = 0, count = entries.size(); i < count; ++i) {
+            auto json_value = document->find(entries[i].value, key);
+            if (!json_value) continue;
+            bool is_integral = (json_value->type == JVAL_INT || json_value->type == JVAL_BOOL);
+            switch (value_type) {
+                case tid_int: {
+                    if (is_integral) new_index->numbers.emplace(lazy_json_to_int(json_value), i);
                     break;
                 }
-            }
-            break;
-        }
-        case tid_bool: {
-            auto value = value_base->as_bool();
-            for (auto& entry : array) {
-                auto obj = entry.getObject();
-                auto json_value = obj[key];
-                if (json_value.isIntegral() && json_value.getBool() == value) {
-                    inner->value = entry;
+                case tid_bool: {
+                    if (is_integral) new_index->numbers.emplace(lazy_json_to_bool(json_value), i);
                     break;
                 }
-            }
-            break;
-        }
-        case tid_string: {
-            string_view value = value_base->as_string();
-            for (auto& entry : array) {
-                auto obj = entry.getObject();
-                auto json_value = obj[key];
-                if (json_value.isString() && json_value.getString() == value) {
-                    inner->value = entry;
+                case tid_string: {
+                    if (json_value->type != JVAL_STRING) break;
+                    new_index->strings.emplace(document->string_value(json_value), i);
+                    break;
+                }
+                default: {
+                    assert(0);
                     break;
                 }
             }
-            break;
         }
-        default: {
-            assert(0);
-            break;
+        index = new_index;
+    }
+
+    auto found = index->find(value_base);
+    return (found != json_find_index_t::not_found) ? entries[found].value : nullptr;
+}
+
+const json_find_index_t* json_find_index(json_document_cache_t* cache, JsonArray array, string_view key,
+                                         typeid_enum_underlying value_type) {
+    if (auto index = cache->find_indices.find(array.values, key, value_type)) return index;
+
+    auto index = cache->find_indices.add(array.values, key, value_type);
+    for (size_t i = 0; i < array.count; ++i) {
+        auto member = cache->find_member(array.values[i].getObject(), key);
+        if (!member) continue;
+        auto json_value = *member;
+        switch (value_type) {
+            case tid_int: {
+                if (json_value.isIntegral()) index->numbers.emplace(json_value.getInt(), i);
+                break;
+            }
+            case tid_bool: {
+                if (json_value.isIntegral()) index->numbers.emplace((int)json_value.getBool(), i);
+                break;
+            }
+            case tid_string: {
+                if (json_value.isString()) index->strings.emplace(json_value.getString(), i);
+                break;
+            }
+            default: {
+                assert(0);
+                break;
+            }
         }
     }
+    return index;
+}
+
+// Records are searched without an index, since they are usually small and aren't kept.
+const JsonValue* json_find_object_linear(JsonArray array, string_view key, const any_t* value_base) {
+    for (auto& entry : array) {
+        auto member = json_find_member(entry.getObject(), key);
+        if (!member) continue;
+        switch (value_base->type.id) {
+            case tid_int: {
+                if (member->isIntegral() && member->getInt() == value_base->as_int()) return &entry;
+                break;
+            }
+            case tid_bool: {
+                if (member->isIntegral() && member->getBool() == value_base->as_bool()) return &entry;
+                break;
+            }
+            case tid_string: {
+                if (member->isString() && string_view{member->getString()} == value_base->as_string()) return &entry;
+                break;
+            }
+            default: {
+                assert(0);
+                break;
+            }
+        }
+    }
+    return nullptr;
+}
+
+any_t json_find_object_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 3);
+    auto json = to_json_value(*arguments[0].dereference());
+    string_view key = arguments[1].dereference()->as_string();
+    auto value_base = arguments[2].dereference();
+    if (json.node) return make_any_json_value(lazy_json_find_object(json.node, key, value_base));
+
+    auto array = json.get().getArray();
+    if (!array) return make_any_json_value((const JsonValue*)nullptr);
+    if (json.record) return make_any_json_value(json, json_find_object_linear(array, key, value_base));
+
+    // The index is built on the first call, later calls with the same array, key and value type only look it up.
+    auto index = json_find_index(current_json_document_cache, array, key, value_base->type.id);
+    auto found = index->find(value_base);
+    return make_any_json_value((found != json_find_index_t::not_found) ? &array.values[found] : nullptr);
+}
+
+// JSON Lines
+
+builtin_arguments_valid_result_t read_json_lines_check(const builtin_state_t& /*state*/,
+                                                       array_view<const typeid_info_match> arguments) {
+    builtin_arguments_valid_result_t result = {{tid_string, 0}, {tid_json_lines, 0}};
+    assert(arguments.size() == 1);
+    if (!arguments[0].is(tid_string, 0)) {
+        result.valid = false;
+        result.invalid_index = 0;
+    }
+    return result;
+}
+
+any_t read_json_lines_call(array_view<any_t> arguments) {
+    auto inner = new wrapped_json_lines();
+
+    assert(arguments.size() == 1);
+    string buffer;
+    auto str = arguments[0].dereference()->as_c_string(&buffer);
+    struct stat info;
+    if (stat(str.data(), &info) == 0) {
+        record_file_dependency(str);
+        inner->filename.assign(str.data(), str.size());
+    }
 
     return make_any_custom(inner);
 }
@@ -321,27 +731,42 @@ builtin_arguments_valid_result_t json_subscript_operator_check(const builtin_sta
     return result;
 }
 
-any_t json_subscript_operator_call(array_view<any_t> arguments) {
-    assert(arguments.size() == 2);
-    auto lhs = arguments[0].dereference();
-    assert(lhs->type.is(tid_json_value, 0));
-    auto json = static_cast<wrapped_json_value*>(lhs->as_custom());
+lazy_json_node_t* lazy_json_subscript(lazy_json_node_t* node, const any_t* key) {
+    auto document = node->document;
+    if (key->type.is(tid_string, 0)) return document->find(node, key->as_string());
+    if (int index = 0; key->try_convert_to_int(&index)) {
+        if (node->type != JVAL_OBJECT && node->type != JVAL_ARRAY) return nullptr;
+        auto& members = document->members(node);
+        if (index >= 0 && (size_t)index < members.size()) return members[index].value;
+    }
+    return nullptr;
+}
 
-    auto inner = new wrapped_json_value{};
-    auto key = arguments[1].dereference();
+const JsonValue* json_subscript(const json_value_t& json, const any_t* key) {
+    auto value = json.get();
     if (key->type.is(tid_string, 0)) {
-        inner->value = json->value.getObject()[string_view{key->as_string()}];
-    } else if (int index = 0; key->try_convert_to_int(&index)) {
-        if (json->value.type == JVAL_OBJECT) {
-            auto object = json->value.getObject();
-            if (index >= 0 && (size_t)index < object.count) {
-                inner->value = object.nodes[index].value;
-            }
-        } else if (json->value.type == JVAL_ARRAY) {
-            inner->value = json->value.getArray()[index];
+        if (json.record) return json_find_member(value.getObject(), key->as_string());
+        return current_json_document_cache->find_member(value.getObject(), key->as_string());
+    }
+    if (int index = 0; key->try_convert_to_int(&index)) {
+        if (index < 0) return nullptr;
+        if (value.type == JVAL_OBJECT) {
+            auto object = value.getObject();
+            if ((size_t)index < object.count) return &object.nodes[index].value;
+        } else if (value.type == JVAL_ARRAY) {
+            auto array = value.getArray();
+            if ((size_t)index < array.count) return &array.values[index];
         }
     }
-    return make_any_custom(inner);
+    return nullptr;
+}
+
+any_t json_subscript_operator_call(array_view<any_t> arguments) {
+    assert(arguments.size() == 2);
+    auto json = to_json_value(*arguments[0].dereference());
+    auto key = arguments[1].dereference();
+    if (json.node) return make_any_json_value(lazy_json_subscript(json.node, key));
+    return make_any_json_value(json, json_subscript(json, key));
 }
 
 // Init
@@ -379,8 +804,9 @@ any_t json_document_root_call(array_view<any_t> arguments) {
     auto lhs = arguments[0].dereference();
     auto json = static_cast<wrapped_json_document*>(lhs->as_custom());
 
-    auto inner = new wrapped_json_value(json->doc.document.root);
-    return make_any_custom(inner);
+    if (json->lazy) return make_any_json_value(json->lazy->root);
+    if (!json->document) return make_any_json_value((const JsonValue*)nullptr);
+    return make_any_json_value(&json->document->doc.document.root);
 }
 
 void init_builtin_json_document(builtin_type_t* type) {
@@ -390,8 +816,20 @@ void init_builtin_json_document(builtin_type_t* type) {
     };
 }
 
+void init_builtin_json_lines(builtin_type_t* type) {
+    type->name = "json_lines";
+    type->is_iteratable = true;
+    type->element_type = {tid_json_value, 0};
+}
+
 void init_builtin_json_extension(builtin_state_t* state) {
-    state->functions.push_back({"read_json_document", 1, 1, read_json_document_check, read_json_document_call});
+    state->functions.push_back(
+        {"read_json_document", 1, 1, read_json_document_check, read_json_document_call, /*reads_external_data=*/true});
+    state->functions.push_back({"read_json_document_lazy", 1, 1, read_json_document_check, read_json_document_lazy_call,
+                                /*reads_external_data=*/true});
+    state->functions.push_back(
+        {"read_json_lines", 1, 1, read_json_lines_check, read_json_lines_call, /*reads_external_data=*/true});
     init_builtin_json_document(&state->custom_types.emplace_back());
     init_builtin_json_value(&state->custom_types.emplace_back());
+    init_builtin_json_lines(&state->custom_types.emplace_back());
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+Hash indices for lookups into json documents, created on first use and cached on the document they index.
+Object indices map keys of large objects to their values, so that json_value["name"] doesn't scan all members.
+Find indices map the values of one member of the objects in an array to the first object that has it, so that repeated
+json_value.find_object calls on the same array and key don't scan the whole array each time.
+*/
+
+struct json_key_hash {
+    size_t operator()(string_view key) const { return hash_identifier(key); }
+};
+
+// Objects with fewer members are searched linearly, since hashing costs more than comparing a few keys.
+constexpr size_t json_object_index_min_members = 16;
+
+template <class Value>
+using json_object_index_t = std::unordered_map<string_view, Value, json_key_hash>;
+
+struct json_find_index_t {
+    std::string key;
+    typeid_enum_underlying value_type;  // tid_int, tid_bool or tid_string, the type of the value that is searched for.
+    // Entry index of the first object by value of its member. Ints and bools are both stored in numbers.
+    std::unordered_map<int, size_t> numbers;
+    json_object_index_t<size_t> strings;
+
+    static constexpr size_t not_found = (size_t)-1;
+
+    size_t find(int value) const {
+        auto it = numbers.find(value);
+        return (it != numbers.end()) ? it->second : not_found;
+    }
+    size_t find(string_view value) const {
+        auto it = strings.find(value);
+        return (it != strings.end()) ? it->second : not_found;
+    }
+    // Value must be of value_type.
+    size_t find(const any_t* value) const {
+        assert(value->type.is(value_type, 0));
+        switch (value_type) {
+            case tid_int: {
+                return find(value->as_int());
+            }
+            case tid_bool: {
+                return find((int)value->as_bool());
+            }
+            case tid_string: {
+                return find(value->as_string());
+            }
+            default: {
+                assert(0);
+                return not_found;
+            }
+        }
+    }
+};
+
+// Find indices by array, arrays are identified by the address of their elements.
+struct json_find_indices_t {
+    std::unordered_map<const void*, vector<json_find_index_t>> arrays;
+
+    // Returns the index of the array for key and value type, or nullptr if it wasn't created yet.
+    const json_find_index_t* find(const void* array, string_view key, typeid_enum_underlying value_type) const {
+        auto it = arrays.find(array);
+        if (it == arrays.end()) return nullptr;
+        for (auto& index : it->second) {
+            if (index.value_type == value_type && string_view{index.key} == key) return &index;
+        }
+        return nullptr;
+    }
+
+    json_find_index_t* add(const void* array, string_view key, typeid_enum_underlying value_type) {
+        auto& index = arrays[array].emplace_back();
+        index.key.assign(key.data(), key.size());
+        index.value_type = value_type;
+        return &index;
+    }
+};
@@ -0,0 +1,419 @@
+/*
+Lazily parsed JSON documents, see read_json_document_lazy in json_extension.cpp. The file is memory mapped and only
+values that a script reads get scanned. Objects and arrays find the bounds of their direct children on first access and
+cache them, anything nested deeper is skipped over without being parsed. Scalars are decoded whenever they are read.
+Memory and time therefore scale with the parts of the document that are used, instead of with the size of the file.
+
+Since most of the document is never parsed, malformed JSON is only detected in scanned parts. Invalid values behave
+like missing values.
+
+The mapping stays alive as long as the document, which is usually until tg exits (see json_document_cache_t). Input
+files must not be modified in place while tg runs: reading a mapped page of a file that was truncated in the meantime
+raises SIGBUS on POSIX systems. Replacing the file, for example by renaming a new file over it, is safe.
+*/
+
+// Read only contents of a whole file. Memory mapped where supported, otherwise the file is read into memory.
+struct mapped_file_t {
+    const char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    tmu_contents contents = {};
+#else
+    void* mapping = nullptr;
+#endif
+
+    mapped_file_t() = default;
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+    ~mapped_file_t() { close(); }
+
+    bool open(const char* filename) {
+        close();
+#ifdef _WIN32
+        auto file = tmu_read_file_as_utf8(filename);
+        if (file.ec != TM_OK) return false;
+        contents = file.contents;
+        data = contents.data;
+        size = contents.size;
+        return true;
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        bool result = fstat(fd, &info) == 0;
+        if (result && info.st_size > 0) {
+            void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                mapping = view;
+                data = (const char*)view;
+                size = (size_t)info.st_size;
+            } else {
+                result = false;
+            }
+        } else if (result) {
+            data = "";
+        }
+        ::close(fd);
+        return result;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) tmu_destroy_contents(&contents);
+        contents = {};
+#else
+        if (mapping) munmap(mapping, size);
+        mapping = nullptr;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+struct lazy_json_node_t;
+struct lazy_json_document_t;
+
+struct lazy_json_member_t {
+    string_view name;  // Key with escape sequences decoded. Empty for array elements.
+    lazy_json_node_t* value;
+};
+
+struct lazy_json_node_t {
+    const char* first;  // Text of the value in the mapped file.
+    const char* last;
+    lazy_json_document_t* document;
+    int type;  // One of the JVAL_* types of tm_json.
+    bool scanned = false;
+    vector<lazy_json_member_t> members;  // Direct children of objects and arrays, filled when first scanned.
+};
+
+bool lazy_json_is_whitespace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+const char* lazy_json_skip_whitespace(const char* p, const char* last) {
+    while (p < last && lazy_json_is_whitespace(*p)) ++p;
+    return p;
+}
+
+// Returns the end of the string starting at p, or nullptr if it is unterminated.
+const char* lazy_json_skip_string(const char* p, const char* last) {
+    assert(p < last && *p == '"');
+    for (++p; p < last; ++p) {
+        if (*p == '\\') {
+            ++p;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return nullptr;
+}
+
+// Returns the end of the value starting at p without parsing nested values, or nullptr if the value is invalid.
+const char* lazy_json_skip_value(const char* p, const char* last) {
+    if (p >= last) return nullptr;
+    switch (*p) {
+        case '"': {
+            return lazy_json_skip_string(p, last);
+        }
+        case '{':
+        case '[': {
+            int depth = 0;
+            for (; p < last; ++p) {
+                switch (*p) {
+                    case '"': {
+                        p = lazy_json_skip_string(p, last);
+                        if (!p) return nullptr;
+                        --p;
+                        break;
+                    }
+                    case '{':
+                    case '[': {
+                        ++depth;
+                        break;
+                    }
+                    case '}':
+                    case ']': {
+                        if (--depth == 0) return p + 1;
+                        break;
+                    }
+                    default: {
+                        break;
+                    }
+                }
+            }
+            return nullptr;
+        }
+        default: {
+            auto start = p;
+            while (p < last && !lazy_json_is_whitespace(*p) && *p != ',' && *p != ']' && *p != '}') ++p;
+            return (p != start) ? p : nullptr;
+        }
+    }
+}
+
+// Type of the value from its text, -1 if it isn't a valid value.
+int lazy_json_value_type(const char* first, const char* last) {
+    string_view text = {first, (size_t)(last - first)};
+    switch (*first) {
+        case '"': {
+            return JVAL_STRING;
+        }
+        case '{': {
+            return JVAL_OBJECT;
+        }
+        case '[': {
+            return JVAL_ARRAY;
+        }
+        case 't':
+        case 'f': {
+            return (text == "true" || text == "false") ? JVAL_BOOL : -1;
+        }
+        case 'n': {
+            return (text == "null") ? JVAL_NULL : -1;
+        }
+        default: {
+            if (*first != '-' && !isdigit((unsigned char)*first)) return -1;
+            bool integral = true;
+            for (auto c : text) {
+                if (c == '.' || c == 'e' || c == 'E') {
+                    integral = false;
+                } else if (!isdigit((unsigned char)c) && c != '-' && c != '+') {
+                    return -1;
+                }
+            }
+            return integral ? JVAL_INT : JVAL_FLOAT;
+        }
+    }
+}
+
+void lazy_json_append_utf8(std::string* out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        *out += (char)codepoint;
+    } else if (codepoint < 0x800) {
+        *out += (char)(0xC0 | (codepoint >> 6));
+        *out += (char)(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        *out += (char)(0xE0 | (codepoint >> 12));
+        *out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *out += (char)(0x80 | (codepoint & 0x3F));
+    } else {
+        *out += (char)(0xF0 | (codepoint >> 18));
+        *out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        *out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *out += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
+
+bool lazy_json_scan_hex4(const char* p, const char* last, uint32_t* out) {
+    if (last - p < 4) return false;
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        result <<= 4;
+        if (c >= '0' && c <= '9') {
+            result |= (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result |= (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            result |= (uint32_t)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    *out = result;
+    return true;
+}
+
+// Decodes escape sequences of the contents of a string (without quotes). Invalid escape sequences are kept as is.
+std::string lazy_json_unescape(string_view raw) {
+    if (!memchr(raw.data(), '\\', raw.size())) return std::string(raw.data(), raw.size());
+
+    std::string result;
+    result.reserve(raw.size());
+    auto last = raw.end();
+    for (auto p = raw.begin(); p < last; ++p) {
+        if (*p != '\\' || p + 1 >= last) {
+            result += *p;
+            continue;
+        }
+        ++p;
+        switch (*p) {
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': {
+                uint32_t codepoint = 0;
+                if (!lazy_json_scan_hex4(p + 1, last, &codepoint)) {
+                    result += "\\u";
+                    break;
+                }
+                p += 4;
+                // Surrogate pairs are written as two escape sequences.
+                uint32_t low = 0;
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 && last - p > 2 && p[1] == '\\' && p[2] == 'u' &&
+                    lazy_json_scan_hex4(p + 3, last, &low) && low >= 0xDC00 && low < 0xE000) {
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                lazy_json_append_utf8(&result, codepoint);
+                break;
+            }
+            default: {
+                // Quotes, backslashes and slashes.
+                result += *p;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+struct lazy_json_document_t {
+    mapped_file_t file;
+    std::deque<lazy_json_node_t> nodes;  // Deque, so that nodes keep their address.
+    std::deque<std::string> decoded_strings;  // Keys and string values that contained escape sequences.
+    std::unordered_map<const lazy_json_node_t*, string_view> decoded_values;
+    lazy_json_node_t* root = nullptr;
+
+    // Lookup indices, see json_index.h.
+    json_find_indices_t find_indices;
+    std::unordered_map<const lazy_json_node_t*, json_object_index_t<lazy_json_node_t*>> object_indices;
+
+    bool open(const char* filename) {
+        if (!file.open(filename)) return false;
+        const char* first = file.data;
+        const char* last = file.data + file.size;
+        // Skip utf-8 byte order mark.
+        if (last - first >= 3 && memcmp(first, "\xEF\xBB\xBF", 3) == 0) first += 3;
+
+        // Only the bounds of the root are checked, so that opening doesn't touch the whole file.
+        first = lazy_json_skip_whitespace(first, last);
+        while (last > first && lazy_json_is_whitespace(last[-1])) --last;
+        if (first == last) return false;
+        if (*first == '{' || *first == '[') {
+            if (last - first < 2 || last[-1] != (*first == '{' ? '}' : ']')) return false;
+        } else if (lazy_json_skip_value(first, last) != last) {
+            return false;
+        }
+        root = make_node(first, last);
+        return root != nullptr;
+    }
+
+    lazy_json_node_t* make_node(const char* first, const char* last) {
+        int type = lazy_json_value_type(first, last);
+        if (type < 0) return nullptr;
+        return &nodes.emplace_back(lazy_json_node_t{first, last, this, type});
+    }
+
+    // Direct children of an object or array, scanned on first access.
+    const vector<lazy_json_member_t>& members(lazy_json_node_t* node) {
+        assert(node);
+        if (!node->scanned) {
+            node->scanned = true;
+            if ((node->type == JVAL_OBJECT || node->type == JVAL_ARRAY) && !scan(node)) node->members.clear();
+        }
+        return node->members;
+    }
+
+    // Child of an object by key, nullptr if there is none.
+    lazy_json_node_t* find(lazy_json_node_t* node, string_view key) {
+        if (node->type != JVAL_OBJECT) return nullptr;
+        auto& node_members = members(node);
+        if (node_members.size() < json_object_index_min_members) {
+            for (auto& member : node_members) {
+                if (member.name == key) return member.value;
+            }
+            return nullptr;
+        }
+
+        auto& index = object_indices[node];
+        if (index.empty()) {
+            // Keep the first of duplicate keys, like the linear search.
+            for (auto& member : node_members) {
+                index.emplace(member.name, member.value);
+            }
+        }
+        auto it = index.find(key);
+        return (it != index.end()) ? it->second : nullptr;
+    }
+
+    // Value of a string node that stays valid as long as the document, escape sequences are decoded.
+    string_view string_value(const lazy_json_node_t* node) {
+        if (!node || node->type != JVAL_STRING) return {};
+        string_view raw = {node->first + 1, (size_t)(node->last - node->first - 2)};
+        if (!memchr(raw.data(), '\\', raw.size())) return raw;
+
+        auto& value = decoded_values[node];
+        if (!value.data()) {
+            auto& decoded = decoded_strings.emplace_back(lazy_json_unescape(raw));
+            value = {decoded.data(), decoded.size()};
+        }
+        return value;
+    }
+
+   private:
+    bool scan(lazy_json_node_t* node) {
+        bool is_object = (node->type == JVAL_OBJECT);
+        char close = is_object ? '}' : ']';
+        // The bounds of node were already validated, so the closing bracket is at last - 1.
+        const char* last = node->last - 1;
+        const char* p = lazy_json_skip_whitespace(node->first + 1, last);
+        if (p == last) return true;
+
+        for (;;) {
+            string_view name = {};
+            if (is_object) {
+                if (p >= last || *p != '"') return false;
+                auto name_last = lazy_json_skip_string(p, last);
+                if (!name_last) return false;
+                name = {p + 1, (size_t)(name_last - p - 2)};
+                if (memchr(name.data(), '\\', name.size())) {
+                    auto& decoded = decoded_strings.emplace_back(lazy_json_unescape(name));
+                    name = {decoded.data(), decoded.size()};
+                }
+                p = lazy_json_skip_whitespace(name_last, last);
+                if (p >= last || *p != ':') return false;
+                p = lazy_json_skip_whitespace(p + 1, last);
+            }
+
+            auto value_last = lazy_json_skip_value(p, last);
+            if (!value_last) return false;
+            auto value = make_node(p, value_last);
+            if (!value) return false;
+            node->members.push_back({name, value});
+
+            p = lazy_json_skip_whitespace(value_last, last);
+            if (p == last) return last[0] == close;
+            if (*p != ',') return false;
+            p = lazy_json_skip_whitespace(p + 1, last);
+        }
+    }
+};
+
+double lazy_json_to_double(const lazy_json_node_t* node) {
+    if (!node || (node->type != JVAL_INT && node->type != JVAL_FLOAT)) return 0;
+    // The mapped file isn't null terminated.
+    char buffer[64];
+    auto size = min((size_t)(node->last - node->first), sizeof(buffer) - 1);
+    memcpy(buffer, node->first, size);
+    buffer[size] = 0;
+    return strtod(buffer, nullptr);
+}
+
+int lazy_json_to_int(const lazy_json_node_t* node) {
+    if (!node) return 0;
+    if (node->type == JVAL_BOOL) return *node->first == 't';
+    if (node->type != JVAL_INT) return (int)lazy_json_to_double(node);
+    int value = 0;
+    scan_i32_n(node->first, (size_t)(node->last - node->first), &value, 10);
+    return value;
+}
+
+bool lazy_json_to_bool(const lazy_json_node_t* node) {
+    if (!node) return false;
+    if (node->type == JVAL_BOOL) return *node->first == 't';
+    return lazy_json_to_int(node) != 0;
+}
@@ -0,0 +1,191 @@
+/*
+Unity build of the embeddable library, the same as main.cpp without the command line tool. See libtg.h for usage.
+*/
+
+#define TG_LIBRARY
+#include "main.cpp"
+
+// clang-format off
+#ifdef _WIN32
+    #define TG_API __declspec(dllexport)
+#else
+    #define TG_API __attribute__((visibility("default")))
+#endif
+// clang-format on
+#include "libtg.h"
+
+struct tg_engine {
+    // Per engine replacements of the defaults used by the command line tool.
+    monotonic_block_allocator allocator;
+    identifier_table_t identifiers;
+    file_dependencies_t file_dependencies;
+    json_document_cache_t json_documents;
+    csv_table_cache_t csv_tables;
+
+    // Allocated and destroyed while the engine is bound, since they live in the engine's allocator.
+    unique_ptr<parsed_state_t> parsed;
+    unique_ptr<process_state_t> process;
+    bool failed = false;  // Adding a script failed.
+};
+
+// Binds the allocator, identifier table, file dependencies and document caches of an engine to the calling thread
+// for the duration of an api call. The previous binding is restored afterwards, so engines can be used from within
+// output callbacks.
+struct tg_engine_binding_t {
+    monotonic_block_allocator* prev_allocator;
+    identifier_table_t* prev_identifiers;
+    file_dependencies_t* prev_file_dependencies;
+    json_document_cache_t* prev_json_documents;
+    csv_table_cache_t* prev_csv_tables;
+
+    explicit tg_engine_binding_t(tg_engine* engine)
+        : prev_allocator(current_allocator),
+          prev_identifiers(current_identifiers),
+          prev_file_dependencies(current_file_dependencies),
+          prev_json_documents(current_json_document_cache),
+          prev_csv_tables(current_csv_table_cache) {
+        assert(engine);
+        current_allocator = &engine->allocator;
+        current_identifiers = &engine->identifiers;
+        current_file_dependencies = &engine->file_dependencies;
+        current_json_document_cache = &engine->json_documents;
+        current_csv_table_cache = &engine->csv_tables;
+    }
+    ~tg_engine_binding_t() {
+        current_allocator = prev_allocator;
+        current_identifiers = prev_identifiers;
+        current_file_dependencies = prev_file_dependencies;
+        current_json_document_cache = prev_json_documents;
+        current_csv_table_cache = prev_csv_tables;
+    }
+    tg_engine_binding_t(const tg_engine_binding_t&) = delete;
+    tg_engine_binding_t& operator=(const tg_engine_binding_t&) = delete;
+};
+
+tg_engine* tg_create(void) {
+    auto engine = new (std::nothrow) tg_engine();
+    if (!engine) return nullptr;
+
+    tg_engine_binding_t binding{engine};
+    try {
+        engine->parsed = std::make_unique<parsed_state_t>();
+    } catch (...) {
+        delete engine;
+        return nullptr;
+    }
+    return engine;
+}
+
+void tg_destroy(tg_engine* engine) {
+    if (!engine) return;
+    {
+        tg_engine_binding_t binding{engine};
+        engine->process.reset();
+        engine->parsed.reset();
+    }
+    delete engine;
+}
+
+int tg_add_script(tg_engine* engine, bool (*parse)(parsed_state_t*, string_view, string_view),
+                  string_view name, string_view contents) {
+    assert(engine);
+    if (engine->process) {
+        print(stderr, "Scripts can't be added to \"{}\" after processing.\n", name);
+        return TG_ERROR;
+    }
+
+    tg_engine_binding_t binding{engine};
+    try {
+        if (parse(engine->parsed.get(), name, contents)) return TG_OK;
+    } catch (...) {
+    }
+    engine->failed = true;
+    return TG_ERROR;
+}
+
+int tg_add_file(tg_engine* engine, const char* filename) {
+    assert(filename);
+    auto parse = [](parsed_state_t* parsed, string_view name, string_view) { return parse_file(parsed, name); };
+    return tg_add_script(engine, parse, filename, {});
+}
+
+int tg_add_string(tg_engine* engine, const char* name, const char* contents, size_t size) {
+    assert(name);
+    assert(contents || !size);
+    return tg_add_script(engine, parse_string, name, {contents, size});
+}
+
+int tg_process(tg_engine* engine) {
+    assert(engine);
+    if (engine->failed || engine->process) return TG_ERROR;
+
+    tg_engine_binding_t binding{engine};
+    try {
+        auto process = std::make_unique<process_state_t>(engine->parsed.get());
+        if (!process_parsed_data(process.get())) return TG_ERROR;
+        engine->process = move(process);
+    } catch (...) {
+        return TG_ERROR;
+    }
+    return TG_OK;
+}
+
+// Runs the toplevel statements, output is left in the process state for the caller to pick up.
+int tg_invoke_toplevel(tg_engine* engine, int argc, const char* const* args) {
+    assert(engine);
+    assert(argc >= 0);
+    assert(args || !argc);
+    if (!engine->process) {
+        print(stderr, "Scripts have to be processed before invoking.\n");
+        return TG_ERROR;
+    }
+
+    auto state = engine->process.get();
+    state->reset_invocation();
+    engine->file_dependencies.data_files.clear();
+
+    vector<any_t> argv_array;
+    auto& source_files = engine->parsed->source_files;
+    argv_array.push_back(make_any(source_files.empty() ? string_view{} : source_files[0].filename));
+    for (int i = 0; i < argc; ++i) {
+        argv_array.push_back(make_any(args[i]));
+    }
+    invoke_toplevel(state, make_any(move(argv_array), {tid_string, 1}));
+    return TG_OK;
+}
+
+int tg_invoke(tg_engine* engine, int argc, const char* const* args, tg_output_callback callback, void* user_data) {
+    tg_engine_binding_t binding{engine};
+    try {
+        if (tg_invoke_toplevel(engine, argc, args) != TG_OK) return TG_ERROR;
+        if (callback) {
+            auto state = engine->process.get();
+            auto& output = state->output.sink.buffer;
+            callback(user_data, nullptr, output.data(), output.size());
+            for (auto& target : state->output_targets) {
+                auto& contents = target->output.sink.buffer;
+                callback(user_data, target->path.c_str(), contents.data(), contents.size());
+            }
+        }
+    } catch (...) {
+        return TG_ERROR;
+    }
+    return TG_OK;
+}
+
+int tg_invoke_to_buffer(tg_engine* engine, int argc, const char* const* args, char* buffer, size_t capacity,
+                        size_t* size) {
+    assert(buffer || !capacity);
+    assert(size);
+    tg_engine_binding_t binding{engine};
+    try {
+        if (tg_invoke_toplevel(engine, argc, args) != TG_OK) return TG_ERROR;
+        auto& output = engine->process->output.sink.buffer;
+        *size = output.size();
+        if (output.size() > capacity) return TG_BUFFER_TOO_SMALL;
+        if (!output.empty()) memcpy(buffer, output.data(), output.size());
+    } catch (...) {
+        return TG_ERROR;
+    }
+    return TG_OK;
+}
@@ -0,0 +1,84 @@
+/*
+C interface for generating code in-process without running the tg executable. It is built as the libtg shared library
+(see rules.mk).
+
+An engine owns its parsed scripts and all memory allocated for them. Scripts are parsed and processed once and can
+then be invoked any number of times with different arguments:
+
+    tg_engine* engine = tg_create();
+    tg_add_file(engine, "library.tg");
+    tg_add_string(engine, "main.tg", "generate(argv[1]);", 18);
+    if (tg_process(engine) == TG_OK) {
+        const char* args[] = {"foo"};
+        tg_invoke(engine, 1, args, output_callback, user_data);
+    }
+    tg_destroy(engine);
+
+Diagnostics are printed to stderr, like the command line tool does. An engine must only be used by one thread at a
+time, different engines can be used by different threads concurrently.
+*/
+
+#ifndef LIBTG_H_INCLUDED
+#define LIBTG_H_INCLUDED
+
+#include <stddef.h>
+
+#ifndef TG_API
+    #ifdef _WIN32
+        #define TG_API __declspec(dllimport)
+    #else
+        #define TG_API
+    #endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    TG_OK = 0,
+    TG_ERROR = 1,
+    TG_BUFFER_TOO_SMALL = 2,
+};
+
+typedef struct tg_engine tg_engine;
+
+/*
+Receives output of an invocation. It is called once with the main output, where path is NULL, and then once for every
+file that $output statements wrote to. Data is not null terminated and only valid for the duration of the call.
+*/
+typedef void (*tg_output_callback)(void* user_data, const char* path, const char* data, size_t size);
+
+TG_API tg_engine* tg_create(void);
+TG_API void tg_destroy(tg_engine* engine);
+
+/*
+Scripts can only be added before tg_process. The name of a script added as a string is used for error messages and to
+resolve its include statements. Returns TG_ERROR if the script couldn't be read or parsed.
+*/
+TG_API int tg_add_file(tg_engine* engine, const char* filename);
+TG_API int tg_add_string(tg_engine* engine, const char* name, const char* contents, size_t size);
+
+/* Type checks all added scripts. Fails if adding any script failed. */
+TG_API int tg_process(tg_engine* engine);
+
+/*
+Runs the toplevel statements of the processed scripts. The argv variable of the scripts is the name of the first
+script, followed by args.
+*/
+TG_API int tg_invoke(tg_engine* engine, int argc, const char* const* args, tg_output_callback callback,
+                     void* user_data);
+
+/*
+Like tg_invoke, but writes the main output into buffer, which is not null terminated. *size receives the size of the
+output. If capacity is too small, nothing is written and TG_BUFFER_TOO_SMALL is returned, so that the caller can invoke
+again with a buffer of at least *size bytes. Files of $output statements are discarded, use tg_invoke to receive them.
+*/
+TG_API int tg_invoke_to_buffer(tg_engine* engine, int argc, const char* const* args, char* buffer, size_t capacity,
+                               size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBTG_H_INCLUDED */
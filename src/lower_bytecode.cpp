@@ -0,0 +1,437 @@
+struct vm_lowering_scope_t {
+    bool is_loop = false;
+    bool is_output_target = false;
+
+    // Segment whitespace that has to be popped when a segment is left early.
+    int indentation = 0;
+    int spaces = 0;
+
+    // Jumps to patch once the loop is fully emitted.
+    int loop_slot = -1;
+    vector<int> break_jumps;
+    vector<int> continue_jumps;
+};
+
+struct vm_lowering_t {
+    parsed_state_t* data;
+    vm_program_t* program;
+    int current_symbol_table = 0;
+    int loop_depth = 0;
+    int operands = 0;
+    bool profile = false;  // Whether to emit op_profile_iteration.
+    vector<vm_lowering_scope_t> scopes;
+
+    int emit(vm_opcode_enum op, int a = 0, int b = 0, int c = 0) {
+        auto& code = program->code;
+        code.push_back({op, a, b, c});
+        operands += vm_operand_delta(code.back());
+        assert(operands >= 0);
+        program->max_operands = max(program->max_operands, operands);
+        return (int)code.size() - 1;
+    }
+    int here() const { return (int)program->code.size(); }
+    void patch(int instruction, int target) {
+        auto& patched = program->code[instruction];
+        if (patched.op == op_for_begin) {
+            patched.c = target;
+        } else {
+            assert(patched.op == op_jump || patched.op == op_jump_if_false || patched.op == op_jump_if_false_keep ||
+                   patched.op == op_jump_if_true_keep || patched.op == op_enter_output_target);
+            patched.a = target;
+        }
+    }
+
+    int add_expression(const expression_t* exp) {
+        program->expressions.push_back(exp);
+        return (int)program->expressions.size() - 1;
+    }
+    int add_constant(any_t value) {
+        program->constants.push_back(std::move(value));
+        return (int)program->constants.size() - 1;
+    }
+    const symbol_entry_t* find_symbol(int name_id) { return data->find_symbol(name_id, current_symbol_table); }
+};
+
+void lower_expression(vm_lowering_t* lowering, const expression_t* exp);
+
+void lower_constant(vm_lowering_t* lowering, const any_t& value) {
+    if (value.type.is(tid_int, 0)) {
+        lowering->emit(op_push_int, value.as_int());
+    } else if (value.type.is(tid_bool, 0)) {
+        lowering->emit(op_push_bool, (int)value.as_bool());
+    } else {
+        lowering->emit(op_push_constant, lowering->add_constant(value));
+    }
+}
+
+void lower_expression_fallback(vm_lowering_t* lowering, const expression_t* exp) {
+    lowering->emit(op_eval_expression, lowering->add_expression(exp));
+}
+
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_identifier_t* exp) {
+    if (exp->result_type.is(tid_function, 0)) {
+        assert(exp->builtin_function);
+        lowering->emit(op_push_constant, lowering->add_constant(make_any(exp->builtin_function)));
+        return;
+    }
+    if (exp->result_type.is(tid_generator, 0)) {
+        assert(exp->symbol);
+        assert(exp->symbol->generator);
+        lowering->emit(op_push_constant, lowering->add_constant(make_any(exp->symbol->generator)));
+        return;
+    }
+    if (!exp->symbol) {
+        // Evaluation will report the error.
+        lower_expression_fallback(lowering, exp);
+        return;
+    }
+    assert(exp->symbol->stack_value_index >= 0);
+    lowering->emit(op_load_local, exp->symbol->stack_value_index);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_compile_time_evaluated_t* exp) {
+    lower_constant(lowering, exp->value);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_constant_t* exp) {
+    // Constants are decoded once here instead of every time they are evaluated.
+    any_t value = evaluate_expression_concrete(nullptr, exp);
+    lower_constant(lowering, value);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_array_t* exp) {
+    for (auto& entry : exp->entries) {
+        lower_expression(lowering, entry.get());
+    }
+    lowering->emit(op_make_array, lowering->add_expression(exp), (int)exp->entries.size());
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_call_t* exp) {
+    auto lhs_type = exp->lhs->result_type;
+    if (lhs_type.is(tid_generator, 0)) {
+        // Generator will evaluate its own arguments.
+        lower_expression(lowering, exp->lhs.get());
+        lowering->emit(op_call_generator, lowering->add_expression(exp));
+        return;
+    }
+    if (!exp->method && !lhs_type.is(tid_function, 0)) {
+        lower_expression_fallback(lowering, exp);
+        return;
+    }
+
+    lower_expression(lowering, exp->lhs.get());
+    for (const auto& arg : exp->arguments) {
+        lower_expression(lowering, arg.get());
+    }
+    auto op = (exp->method) ? op_call_method : op_call_function;
+    lowering->emit(op, lowering->add_expression(exp), (int)exp->arguments.size());
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_subscript_t* exp) {
+    lower_expression(lowering, exp->lhs.get());
+    lower_expression(lowering, exp->rhs.get());
+    lowering->emit(op_subscript, lowering->add_expression(exp));
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_instanceof_t* exp) {
+    lower_expression_fallback(lowering, exp);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_dot_t* exp) {
+    lower_expression(lowering, exp->lhs.get());
+    lowering->emit(op_dot, lowering->add_expression(exp));
+}
+
+void lower_unary(vm_lowering_t* lowering, const expression_one_t* exp, vm_opcode_enum op) {
+    lower_expression(lowering, exp->child.get());
+    lowering->emit(op, lowering->add_expression(exp));
+}
+void lower_binary(vm_lowering_t* lowering, const expression_two_t* exp, vm_opcode_enum op, int b = 0) {
+    lower_expression(lowering, exp->lhs.get());
+    lower_expression(lowering, exp->rhs.get());
+    lowering->emit(op, lowering->add_expression(exp), b);
+}
+
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_unary_plus_t* exp) {
+    lower_unary(lowering, exp, op_to_int);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_unary_minus_t* exp) {
+    lower_unary(lowering, exp, op_negate);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_not_t* exp) {
+    lower_unary(lowering, exp, op_not);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_mul_t* exp) {
+    lower_binary(lowering, exp, op_mul);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_div_t* exp) {
+    lower_binary(lowering, exp, op_div);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_mod_t* exp) {
+    lower_binary(lowering, exp, op_mod);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_add_t* exp) {
+    lower_binary(lowering, exp, op_add);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_sub_t* exp) {
+    lower_binary(lowering, exp, op_sub);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_lt_t* exp) {
+    lower_binary(lowering, exp, op_lt);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_lte_t* exp) {
+    lower_binary(lowering, exp, op_lte);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_gt_t* exp) {
+    lower_binary(lowering, exp, op_gt);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_gte_t* exp) {
+    lower_binary(lowering, exp, op_gte);
+}
+
+vm_opcode_enum get_equality_opcode(const expression_two_t* exp) {
+    auto lhs = exp->lhs->result_type;
+    auto rhs = exp->rhs->result_type;
+    auto is_int_or_bool = [](typeid_info type) { return type.is(tid_int, 0) || type.is(tid_bool, 0); };
+    if (is_int_or_bool(lhs) && is_int_or_bool(rhs)) return op_eq_int;
+    if (lhs.is(tid_string, 0) && rhs.is(tid_string, 0)) return op_eq_string;
+    return op_eq;
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_eq_t* exp) {
+    lower_binary(lowering, exp, get_equality_opcode(exp), /*negate=*/0);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_neq_t* exp) {
+    lower_binary(lowering, exp, get_equality_opcode(exp), /*negate=*/1);
+}
+
+void lower_short_circuit(vm_lowering_t* lowering, const expression_two_t* exp, vm_opcode_enum jump) {
+    auto index = lowering->add_expression(exp);
+    lower_expression(lowering, exp->lhs.get());
+    lowering->emit(op_to_bool, index);
+    auto skip_rhs = lowering->emit(jump);
+    lower_expression(lowering, exp->rhs.get());
+    lowering->emit(op_to_bool, index);
+    lowering->patch(skip_rhs, lowering->here());
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_and_t* exp) {
+    lower_short_circuit(lowering, exp, op_jump_if_false_keep);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_or_t* exp) {
+    lower_short_circuit(lowering, exp, op_jump_if_true_keep);
+}
+void lower_expression_concrete(vm_lowering_t* lowering, const expression_assign_t* exp) {
+    lower_binary(lowering, exp, op_assign);
+}
+
+void lower_expression(vm_lowering_t* lowering, const expression_t* exp) {
+    assert(exp);
+    visit_expression(exp, [lowering](auto* exp) { lower_expression_concrete(lowering, exp); });
+}
+
+// Expression whose value is consumed by the instruction emitted right after it.
+void lower_statement_expression(vm_lowering_t* lowering, const expression_t* exp) {
+    assert(lowering->operands == 0);
+    auto first = lowering->here();
+    lower_expression(lowering, exp);
+    lowering->program->expression_ranges.push_back({first, lowering->here()});
+}
+
+// Leaves segments, output statements and for statements, innermost first, until the for statement that
+// break/continue refers to. With target_loop_level < 0 everything is left, which is what return does.
+vm_lowering_scope_t* lower_scope_exit(vm_lowering_t* lowering, int target_loop_level) {
+    int loop_level = 0;
+    for (auto it = lowering->scopes.rbegin(), last = lowering->scopes.rend(); it != last; ++it) {
+        if (it->is_output_target) {
+            // Break and continue can't leave output statements, see parse_output_statement.
+            assert(target_loop_level < 0);
+            lowering->emit(op_leave_output_target);
+            continue;
+        }
+        if (!it->is_loop) {
+            lowering->emit(op_pop_line, 0, it->indentation, it->spaces);
+            continue;
+        }
+        if (loop_level == target_loop_level) return &*it;
+        lowering->emit(op_for_end, it->loop_slot);
+        ++loop_level;
+    }
+    assert(target_loop_level < 0);
+    return nullptr;
+}
+
+void lower_literal_body(vm_lowering_t* lowering, const literal_block_t& block);
+void lower_segment(vm_lowering_t* lowering, const formatted_segment_t& segment) {
+    auto program = lowering->program;
+    auto ws = segment.whitespace;
+    lowering->emit(op_push_line, ws.preceding_newlines, ws.indentation, ws.spaces);
+    {
+        auto& scope = lowering->scopes.emplace_back();
+        scope.indentation = ws.indentation;
+        scope.spaces = ws.spaces;
+    }
+
+    for (const auto& statement : segment.statements) {
+        switch (statement.type) {
+            case stmt_literal: {
+                auto& literal = statement.literal;
+                if (!literal.empty()) {
+                    program->literals.push_back(literal);
+                    lowering->emit(op_output_literal, (int)program->literals.size() - 1, statement.spaces);
+                }
+                continue;
+            }
+            case stmt_if: {
+                const auto& if_statement = statement.if_statement;
+                auto prev_scope = lowering->current_symbol_table;
+                // eliminate_dead_branch leaves a constant true condition without else block. Other constant conditions
+                // are kept when they can't be converted to bool, so they still need the jump.
+                auto constant = get_compile_time_value(if_statement.condition.get());
+                if (constant && constant->is(tid_bool, 0) && constant->as_bool() && !if_statement.else_block.valid) {
+                    lowering->current_symbol_table = if_statement.then_scope_index;
+                    lower_literal_body(lowering, if_statement.then_block);
+                    lowering->current_symbol_table = prev_scope;
+                    continue;
+                }
+
+                lower_statement_expression(lowering, if_statement.condition.get());
+                auto jump_to_else = lowering->emit(op_jump_if_false);
+
+                assert(if_statement.then_block.valid);
+                lowering->current_symbol_table = if_statement.then_scope_index;
+                lower_literal_body(lowering, if_statement.then_block);
+                if (if_statement.else_block.valid) {
+                    auto jump_to_end = lowering->emit(op_jump);
+                    lowering->patch(jump_to_else, lowering->here());
+                    assert(if_statement.else_scope_index >= 0);
+                    lowering->current_symbol_table = if_statement.else_scope_index;
+                    lower_literal_body(lowering, if_statement.else_block);
+                    lowering->patch(jump_to_end, lowering->here());
+                } else {
+                    lowering->patch(jump_to_else, lowering->here());
+                }
+                lowering->current_symbol_table = prev_scope;
+                continue;
+            }
+            case stmt_for: {
+                const auto& for_statement = statement.for_statement;
+                auto prev_scope = lowering->current_symbol_table;
+                lowering->current_symbol_table = for_statement.scope_index;
+                auto symbol = lowering->find_symbol(for_statement.variable_id);
+                assert(symbol);
+
+                lower_statement_expression(lowering, for_statement.container_expression.get());
+                if (for_statement.mutable_elements) lowering->emit(op_pin_array);
+                auto loop_slot = lowering->loop_depth++;
+                program->loop_slots = max(program->loop_slots, lowering->loop_depth);
+                auto begin = lowering->emit(op_for_begin, loop_slot, symbol->stack_value_index);
+
+                auto body = lowering->here();
+                lowering->scopes.emplace_back().is_loop = true;
+                lowering->scopes.back().loop_slot = loop_slot;
+                if (lowering->profile) {
+                    program->for_statements.push_back(&for_statement);
+                    lowering->emit(op_profile_iteration, (int)program->for_statements.size() - 1);
+                }
+                lower_literal_body(lowering, for_statement.body);
+                auto next = lowering->emit(op_for_next, loop_slot, symbol->stack_value_index, body);
+                auto end = lowering->emit(op_for_end, loop_slot);
+
+                auto& scope = lowering->scopes.back();
+                lowering->patch(begin, end);
+                for (auto jump : scope.continue_jumps) lowering->patch(jump, next);
+                for (auto jump : scope.break_jumps) lowering->patch(jump, end);
+                lowering->scopes.pop_back();
+
+                --lowering->loop_depth;
+                lowering->current_symbol_table = prev_scope;
+                continue;
+            }
+            case stmt_output: {
+                const auto& output_statement = statement.output_statement;
+                lower_statement_expression(lowering, output_statement.path_expression.get());
+                auto enter = lowering->emit(op_enter_output_target);
+
+                auto prev_scope = lowering->current_symbol_table;
+                lowering->current_symbol_table = output_statement.scope_index;
+                lowering->scopes.emplace_back().is_output_target = true;
+                lower_literal_body(lowering, output_statement.body);
+                lowering->scopes.pop_back();
+                lowering->current_symbol_table = prev_scope;
+
+                lowering->emit(op_leave_output_target);
+                lowering->patch(enter, lowering->here());
+                continue;
+            }
+            case stmt_expression: {
+                lowering->emit(op_begin_output, statement.spaces);
+                lower_statement_expression(lowering, statement.formatted.expression.get());
+                program->formats.push_back(statement.formatted.format);
+                lowering->emit(op_output_value, (int)program->formats.size() - 1, statement.spaces);
+                continue;
+            }
+            case stmt_comma: {
+                auto comma = statement.comma;
+                assert(comma.index >= 0);
+                lowering->emit(op_output_comma, comma.index, (int)comma.space_after, statement.spaces);
+                continue;
+            }
+            case stmt_declaration: {
+                auto declaration = &statement.declaration;
+                auto symbol = lowering->find_symbol(declaration->variable.identifier_id);
+                assert(symbol);
+                if (declaration->expression) {
+                    lower_statement_expression(lowering, declaration->expression.get());
+                    lowering->emit(op_store_local, symbol->stack_value_index);
+                } else {
+                    lowering->emit(op_init_local, symbol->stack_value_index, declaration->type.id,
+                                   declaration->type.array_level);
+                }
+                continue;
+            }
+            case stmt_break:
+            case stmt_continue: {
+                auto loop = lower_scope_exit(lowering, statement.break_continue_statement.level);
+                assert(loop);
+                auto jump = lowering->emit(op_jump);
+                if (statement.type == stmt_break) {
+                    loop->break_jumps.push_back(jump);
+                } else {
+                    loop->continue_jumps.push_back(jump);
+                }
+                break;
+            }
+            case stmt_return: {
+                lower_scope_exit(lowering, -1);
+                lowering->emit(op_return);
+                break;
+            }
+            case stmt_none: {
+                assert(0 && "Unhandled switch case.");
+                continue;
+            }
+        }
+        // Statements following break, continue or return are never executed.
+        break;
+    }
+
+    lowering->scopes.pop_back();
+    lowering->emit(op_pop_line, 0, ws.indentation, ws.spaces);
+}
+
+void lower_literal_body(vm_lowering_t* lowering, const literal_block_t& block) {
+    assert(block.valid);
+    for (const auto& segment : block.segments) {
+        lower_segment(lowering, segment);
+    }
+}
+
+void lower_generator_to_bytecode(process_state_t* state, const generator_t& generator) {
+    assert(generator.program.code.empty());
+    vm_lowering_t lowering = {state->data, &generator.program, generator.scope_index};
+    lowering.profile = (state->profiler != nullptr);
+    lower_literal_body(&lowering, generator.body);
+    lowering.emit(op_return);
+    assert(lowering.scopes.empty());
+}
+
+void lower_toplevel_to_bytecode(process_state_t* state) {
+    auto data = state->data;
+    vm_lowering_t lowering = {data, &data->toplevel_program, /*current_symbol_table=*/0};
+    lowering.profile = (state->profiler != nullptr);
+    lower_segment(&lowering, data->toplevel_segment);
+    lowering.emit(op_return);
+    assert(lowering.scopes.empty());
+}
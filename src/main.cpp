@@ -5,8 +5,7 @@ TODO:
     - Implement comments.
     - Implement string printing in the scripting language.
     - Implement string escaping/quoting.
-    - Implement multiple output files (header/implementation).
-        - Add file io functions, for instance for generating boilerplate code if a file doesn't exist.
+    - Add file io functions, for instance for generating boilerplate code if a file doesn't exist.
     - Implement direct clang-format integration through a command line option.
     - Implement tuples/structs.
 FIXME:
@@ -20,12 +19,18 @@ FIXME:
 #include <cstring>
 #include <cctype>
 #include <cstdarg>
+#include <cerrno>
+#include <cstdlib>
 
 /* POSIX */
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef _WIN32
 #include <io.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #endif
 
 /* stl */
@@ -35,6 +40,12 @@ FIXME:
 #include <algorithm>
 #include <utility>
 #include <set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <deque>
 
 using std::begin;
 using std::end;
@@ -116,6 +127,9 @@ bool operator!=(string_view a, string_view b) { return !tmsu_equals_n(a.begin(),
 /* tg */
 
 #include "monotonic_allocator.h"
+#include "identifier_table.h"
+#include "file_dependencies.h"
+#include "file_cache.h"
 #include "tokenizer.h"
 #include "typeinfo.h"
 #include "match_type_definition.h"
@@ -126,7 +140,10 @@ bool operator!=(string_view a, string_view b) { return !tmsu_equals_n(a.begin(),
 #include "builtin_array.cpp"
 #include "builtin_string.cpp"
 #include "builtin_state.h"
+#include "json_index.h"
+#include "lazy_json.h"
 #include "json_extension.cpp"
+#include "csv_extension.cpp"
 #include "builtin_state.cpp"
 
 enum class parse_result { no_match, error, success };
@@ -137,6 +154,7 @@ constexpr const parse_result pr_no_match = parse_result::no_match;
 
 #include "expressions.h"
 #include "statement.cpp"
+#include "bytecode.h"
 #include "generator.h"
 
 #include "error_printing.h"
@@ -147,6 +165,7 @@ constexpr const parse_result pr_no_match = parse_result::no_match;
 
 #include "parsed_state.h"
 #include "process_state.h"
+#include "profiler.h"
 #include "error_printing.cpp"
 
 #include "parse_expression.cpp"
@@ -157,8 +176,10 @@ constexpr const parse_result pr_no_match = parse_result::no_match;
 #include "parsing.h"
 
 #include "process_parsed_state.h"
+#include "lower_bytecode.cpp"
 
 #include "invoke.cpp"
+#include "invoke_vm.cpp"
 
 bool parse_contents(parsing_state_t* parsing, int file_index) {
     auto data = parsing->data;
@@ -171,7 +192,7 @@ bool parse_contents(parsing_state_t* parsing, int file_index) {
         assert(parsing->current_symbol_table == 0);  // If this assertion hits, push_scope and pop_scope aren't matched.
     }
 
-    if (pr == pr_error) {
+    if (pr == pr_error && !suppress_error_output) {
         if (filename.empty()) {
             tmu_fprintf(stderr, "Failure.\n");
         } else {
@@ -184,17 +205,16 @@ bool parse_contents(parsing_state_t* parsing, int file_index) {
     return (pr == pr_success);
 }
 
-bool parse_source_file(parsing_state_t* parsing, int file_index) {
-    // Parsing of the file might add new files, which would invalidate any references into the array.
-    // That is why we just refer to the source file by index.
-    auto data = parsing->data;
+// Reads the contents of a file that was already added to source_files.
+bool load_source_file(parsed_state_t* data, int file_index) {
     auto filename = data->source_files[file_index].filename;
     assert(!data->source_files[file_index].parsed);
+    parsed_state_scope_t parsed_scope{data};
 
     // Files read with tmu are always null terminated.
     auto script = tml::make_resource(tmu_read_file_as_utf8(filename));
     if (script->ec != TM_OK) {
-        print(stderr, "Failed to load script file \"{}\".\n", filename);
+        if (!suppress_error_output) print(stderr, "Failed to load script file \"{}\".\n", filename);
         return false;
     }
 
@@ -202,30 +222,56 @@ bool parse_source_file(parsing_state_t* parsing, int file_index) {
     memcpy(persistent_contents, script->contents.data, script->contents.size + 1);  // Copy including null terminator.
 
     data->source_files[file_index].contents = {persistent_contents, script->contents.size};
+    return true;
+}
+
+bool parse_source_file(parsing_state_t* parsing, int file_index) {
+    // Parsing of the file might add new files, which would invalidate any references into the array.
+    // That is why we just refer to the source file by index.
+    auto data = parsing->data;
+    if (!load_source_file(data, file_index)) return false;
 
+    parsed_state_scope_t parsed_scope{data};
     return parse_contents(parsing, file_index);
 }
 
-bool parse_file(parsed_state_t* parsed, string_view filename) {
+// Parses a file that was already added to source_files.
+bool parse_added_file(parsed_state_t* parsed, int file_index) {
     assert(parsed);
 
     if (parsed->verbose) {
-        print(stdout, "Parsing \"{}\".\n", filename);
+        print(stdout, "Parsing \"{}\".\n", parsed->source_files[file_index].filename);
     }
 
     parsing_state_t parsing = {parsed};
     parsing.current_stack_size = parsed->toplevel_stack_size;
-    auto& source_files = parsed->source_files;
-    source_files.push_back({/*contents=*/{}, filename, /*file_index=*/0, /*parsed=*/false});
-    if (parse_source_file(&parsing, (int)source_files.size() - 1)) {
+    if (parse_source_file(&parsing, file_index)) {
         parsed->toplevel_stack_size = parsing.current_stack_size;
         return true;
     }
     return false;
 }
 
+int add_source_file(parsed_state_t* parsed, string_view filename) {
+    parsed_state_scope_t parsed_scope{parsed};
+    // file_data only keeps a view of the filename.
+    auto persistent_filename = monotonic_new_array<char>(filename.size() + 1);
+    memcpy(persistent_filename, filename.data(), filename.size());
+
+    auto& source_files = parsed->source_files;
+    int file_index = (int)source_files.size();
+    source_files.push_back({/*contents=*/{}, {persistent_filename, filename.size()}, file_index, /*parsed=*/false});
+    return file_index;
+}
+
+bool parse_file(parsed_state_t* parsed, string_view filename) {
+    assert(parsed);
+    return parse_added_file(parsed, add_source_file(parsed, filename));
+}
+
 bool parse_inplace(parsed_state_t* parsed, string_view contents) {
     assert(parsed);
+    parsed_state_scope_t parsed_scope{parsed};
 
     if (parsed->verbose) {
         print(stdout, "Parsing piped input.\n");
@@ -243,4 +289,38 @@ bool parse_inplace(parsed_state_t* parsed, string_view contents) {
     return false;
 }
 
+// Parses a script that is already in memory. Contents and name are copied. The name is used for error messages and to
+// resolve include statements relative to it.
+bool parse_string(parsed_state_t* parsed, string_view name, string_view contents) {
+    assert(parsed);
+    parsed_state_scope_t parsed_scope{parsed};
+
+    if (parsed->verbose) {
+        print(stdout, "Parsing \"{}\".\n", name);
+    }
+
+    auto persistent_contents = monotonic_new_array<char>(contents.size() + 1);
+    memcpy(persistent_contents, contents.data(), contents.size());
+    persistent_contents[contents.size()] = 0;
+    auto persistent_name = monotonic_new_array<char>(name.size() + 1);
+    memcpy(persistent_name, name.data(), name.size());
+
+    parsing_state_t parsing = {parsed};
+    parsing.current_stack_size = parsed->toplevel_stack_size;
+    auto& source_files = parsed->source_files;
+    source_files.push_back({{persistent_contents, contents.size()}, {persistent_name, name.size()},
+                            /*file_index=*/(int)source_files.size(), /*parsed=*/false});
+    if (parse_contents(&parsing, (int)source_files.size() - 1)) {
+        parsed->toplevel_stack_size = parsing.current_stack_size;
+        return true;
+    }
+    return false;
+}
+
+#include "parse_cache.cpp"
+#include "parse_files.cpp"
+
+// The embeddable library (libtg.cpp) includes this file for everything except the command line tool.
+#ifndef TG_LIBRARY
 #include "cli.cpp"
+#endif
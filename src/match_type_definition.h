@@ -5,6 +5,7 @@ struct type_field {
     int match_index = -1; // Index into type_pattern.match_entries.
 };
 
+// Number of words an mt_word entry matches, max is exclusive and negative if there is no upper bound.
 struct word_range_t {
     int16_t min;
     int16_t max;
@@ -35,6 +36,12 @@ struct type_pattern {
     vector<type_field> fields;
     vector<type_match_entry> match_entries;
 
+    // Matcher, precomputed by compile_match_type_definition.
+    vector<word_range_t> word_ranges;  // Initial ranges of the mt_word entries in order.
+    // Whether words can be distributed between mt_word entries in more than one way. Only ambiguous patterns need to
+    // retry with narrower word ranges after a failed match.
+    bool ambiguous = false;
+
     int find_match_index_from_field_name(string_view name) const {
         for (int i = 0, count = (int)fields.size(); i < count; ++i) {
             auto field = fields[i];
@@ -56,6 +63,9 @@ struct type_pattern {
 struct type_sum {
     vector<string_token> names;
     vector<const match_type_definition_t*> entries;
+    // Precomputed by compile_match_type_definition: the word each entry starts with, empty if it doesn't start with a
+    // raw word. Entries whose first word doesn't match aren't tried.
+    vector<string> first_words;
 };
 
 enum match_type_definition_enum { td_none, td_pattern, td_sum };
@@ -159,4 +169,29 @@ typeid_info typeid_from_definition(const match_type_definition_t& definition) {
         result = {tid_sum, 0};
     }
     return result;
-}
\ No newline at end of file
+}
+
+// Precomputes what string matching needs to know about a definition, once its names are resolved.
+void compile_match_type_definition(match_type_definition_t* definition) {
+    if (definition->type == td_pattern) {
+        auto pattern = &definition->pattern;
+        pattern->word_ranges.clear();
+        pattern->ambiguous = false;
+        for (auto& entry : pattern->match_entries) {
+            if (entry.type != mt_word) continue;
+            auto range = entry.word_range;
+            pattern->word_ranges.push_back(range);
+            // Ranges without an upper bound or that allow more than one count can be narrowed when retrying.
+            if (range.max < 0 || range.max - range.min > 1) pattern->ambiguous = true;
+        }
+    } else if (definition->type == td_sum) {
+        auto sum = &definition->sum;
+        sum->first_words.clear();
+        for (auto entry : sum->entries) {
+            auto& first_word = sum->first_words.emplace_back();
+            if (entry->type != td_pattern || entry->pattern.match_entries.empty()) continue;
+            auto& first = entry->pattern.match_entries[0];
+            if (first.type == mt_raw) first_word = first.contents;
+        }
+    }
+}
@@ -40,15 +40,16 @@ class monotonic_allocator {
     void* alloc(size_t size) {
         char* result = ptr + sz;
         // Result should be aligned.
-        assert(((uintptr_t)result % sizeof(max_align_t)) == 0);
+        assert(((uintptr_t)result % alignof(max_align_t)) == 0);
 
-        auto alignment_offset = get_alignment_offset(result + size, sizeof(max_align_t));
+        auto alignment_offset = get_alignment_offset(result + size, alignof(max_align_t));
         if (sz + size + alignment_offset > cap) return nullptr;
 
         sz += size + alignment_offset;
         return result;
     }
 
+    const char* data() const { return ptr; }
     size_t size() const { return sz; }
     size_t capacity() const { return cap; }
 
@@ -61,50 +62,124 @@ class monotonic_allocator {
     bool owns(const void* allocation) const { return allocation >= ptr && allocation < ptr + sz; };
 };
 
+struct monotonic_allocator_stats_t {
+    size_t used;      // Bytes handed out, including alignment padding.
+    size_t reserved;  // Bytes of all blocks.
+    size_t wasted;    // Unused bytes at the end of blocks that are no longer allocated from.
+    size_t blocks;
+};
+
 class monotonic_block_allocator {
-    static constexpr size_t block_size = 4 * 1024;  // 4 kilobytes
+    // Blocks grow geometrically, so that large scripts need few blocks.
+    static constexpr size_t min_block_size = 4 * 1024;     // 4 kilobytes
+    static constexpr size_t max_block_size = 1024 * 1024;  // 1 megabyte
+    // The active allocator is always at the back.
     vector<monotonic_allocator> allocators;
+    size_t next_block_size = min_block_size;
+
+    // Memory ranges of all allocators sorted by address, to look up the owner of a pointer with a binary search.
+    struct block_range_t {
+        const char* first;
+        const char* last;
+    };
+    vector<block_range_t> ranges;
+
+    void add_range(const monotonic_allocator& allocator) {
+        block_range_t range = {allocator.data(), allocator.data() + allocator.capacity()};
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), range.first,
+                                   [](const char* ptr, const block_range_t& entry) { return ptr < entry.first; });
+        ranges.insert(it, range);
+    }
+    void add_block(size_t size) {
+        add_range(allocators.emplace_back(size));
+    }
 
    public:
-    monotonic_block_allocator() { allocators.emplace_back(block_size); }
+    monotonic_block_allocator() { add_block(next_block_size); }
 
     void* alloc(size_t size) {
         void* result = allocators.back().alloc(size);
         // Check to see if we need a new monotonic allocator.
         if (!result) {
-            if (size > block_size) {
+            next_block_size = min(next_block_size * 2, max_block_size);
+            if (size > next_block_size) {
                 // Allocation size is more than the block size of a single monotonic allocator.
                 // So we create memory just for this single allocation without making the resulting allocator the active
                 // one, since it is immediately empty.
-                auto new_allocator = monotonic_allocator{size + sizeof(max_align_t)};
+                auto new_allocator = monotonic_allocator{size + alignof(max_align_t)};
                 result = new_allocator.alloc(size);
+                add_range(new_allocator);
                 // The new allocator is not the active one since it is not at the back.
                 allocators.insert(allocators.end() - 1, std::move(new_allocator));
             } else {
-                auto& new_allocator = allocators.emplace_back(block_size);
-                result = new_allocator.alloc(size);
+                add_block(next_block_size);
+                result = allocators.back().alloc(size);
             }
         }
         assert(result);
         return result;
     }
 
+    // Takes over all memory of other, so that allocations made with other live as long as this allocator.
+    void adopt(monotonic_block_allocator&& other) {
+        for (auto& allocator : other.allocators) {
+            add_range(allocator);
+        }
+        // Keep the active allocator at the back.
+        allocators.insert(allocators.end() - 1, std::make_move_iterator(other.allocators.begin()),
+                          std::make_move_iterator(other.allocators.end()));
+        other.allocators.clear();
+        other.ranges.clear();
+        other.next_block_size = min_block_size;
+        other.add_block(other.next_block_size);
+    }
+
     bool owns(const void* ptr) const {
         if (!ptr) return false;
+        // Most lookups are for recent allocations, which come from the active allocator.
+        if (allocators.back().owns(ptr)) return true;
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), (const char*)ptr,
+                                   [](const char* ptr, const block_range_t& entry) { return ptr < entry.first; });
+        return it != ranges.begin() && ptr < (it - 1)->last;
+    };
+
+    monotonic_allocator_stats_t stats() const {
+        monotonic_allocator_stats_t result = {};
         for (auto& allocator : allocators) {
-            if (allocator.owns(ptr)) return true;
+            result.used += allocator.size();
+            result.reserved += allocator.capacity();
         }
-        return false;
-    };
+        result.wasted = result.reserved - result.used - (allocators.back().capacity() - allocators.back().size());
+        result.blocks = allocators.size();
+        return result;
+    }
 };
 
-monotonic_block_allocator global_allocator;
+// Allocator that monotonic_new allocates from. Each thread has its own default_allocator, so that threads never share an
+// allocator by accident. Parsed data binds the allocator it was created with while parsing and processing (see
+// parsed_state_t::allocator), instances of the embeddable library (see libtg.cpp) bind their own allocator for the
+// duration of each call.
+thread_local monotonic_block_allocator default_allocator;
+thread_local monotonic_block_allocator* current_allocator = &default_allocator;
+
+// Binds allocator to the calling thread while in scope, the previous allocator is restored afterwards.
+struct monotonic_allocator_scope_t {
+    monotonic_block_allocator* prev_allocator;
+
+    explicit monotonic_allocator_scope_t(monotonic_block_allocator* allocator) : prev_allocator(current_allocator) {
+        assert(allocator);
+        current_allocator = allocator;
+    }
+    ~monotonic_allocator_scope_t() { current_allocator = prev_allocator; }
+    monotonic_allocator_scope_t(const monotonic_allocator_scope_t&) = delete;
+    monotonic_allocator_scope_t& operator=(const monotonic_allocator_scope_t&) = delete;
+};
 
-bool is_from_monotonic(const void* ptr) { return global_allocator.owns(ptr); }
+bool is_from_monotonic(const void* ptr) { return current_allocator->owns(ptr); }
 
 template <class T, class... Args>
 T* monotonic_new(Args&&... args) {
-    void* storage = global_allocator.alloc(sizeof(T));
+    void* storage = current_allocator->alloc(sizeof(T));
     assert(storage);
     return ::new (storage) T(std::forward<Args>(args)...);
 }
@@ -112,7 +187,7 @@ T* monotonic_new(Args&&... args) {
 template <class T>
 T* monotonic_new_array(size_t count) {
     assert(count);
-    T* storage = (T*)global_allocator.alloc(sizeof(T) * count);
+    T* storage = (T*)current_allocator->alloc(sizeof(T) * count);
     assert(storage);
     auto first = ::new ((void*)storage) T();
     for (size_t i = 1; i < count; ++i) {
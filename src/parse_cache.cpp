@@ -0,0 +1,806 @@
+/*
+On-disk cache of parsed source files, enabled with --cache. Files parsed by parse_files are stored in the cache
+directory under the hash of their contents, so that unchanged library files don't have to be tokenized and parsed again
+by the next invocation. Cached files are only used if they were written with the same format, see parse_cache_version.
+
+A cached file stores what parsing a single file produces: match type definitions, generators, symbol tables and
+toplevel statements. Views into the source file are stored as offsets, since the contents of the file are loaded anyway
+to compute the hash. Interned identifiers are interned again on load. Type inference still runs on the loaded data (see
+process_parsed_data), since inferred expressions refer to builtin functions and values that only live in memory.
+*/
+
+// Bumped whenever what is stored changes, including the values of stored enums.
+const uint32_t parse_cache_version = 1;
+static const char parse_cache_magic[8] = {'t', 'g', 'c', 'a', 'c', 'h', 'e', 0};
+// Sizes of the types that are stored as raw bytes. Cached files written by a build where they differ aren't used.
+static const uint32_t parse_cache_layout[] = {
+    sizeof(typeid_info),  sizeof(stream_loc_t),         sizeof(PrintFormat),
+    sizeof(word_range_t), sizeof(expression_type_enum), sizeof(whitespace_state),
+    sizeof(exp_value_category_enum),
+};
+
+uint64_t hash_contents(string_view contents) {
+    // 64 bit FNV-1a.
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : contents) {
+        hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string cached_file_path(string_view directory, uint64_t contents_hash) {
+    char name[32];
+    snprintf(name, std::size(name), "%016llx.tgc", (unsigned long long)contents_hash);
+
+    std::string result{directory.data(), directory.size()};
+    if (!result.empty() && result.back() != '/' && result.back() != '\\') result += '/';
+    result += name;
+    return result;
+}
+
+struct parse_cache_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout[std::size(parse_cache_layout)];
+    int32_t file_index;  // Index of the file when it was stored, locations in that file are remapped on load.
+    uint64_t contents_size;
+    uint64_t contents_hash;
+    uint64_t body_size;
+};
+
+// Writing
+
+struct parse_cache_writer_t {
+    std::string buffer;
+    string_view contents;
+    int file_index = -1;
+    std::unordered_map<const match_type_definition_t*, int> definition_indices;
+    std::unordered_map<const generator_t*, int> generator_indices;
+    // Whether everything written is part of the parsed file. Data that is only set when processing isn't stored.
+    bool valid = true;
+};
+
+template <class T>
+void cache_write_raw(parse_cache_writer_t* writer, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    writer->buffer.append((const char*)&value, sizeof(T));
+}
+void cache_write(parse_cache_writer_t* writer, int value) { cache_write_raw<int32_t>(writer, value); }
+void cache_write(parse_cache_writer_t* writer, bool value) { cache_write_raw<uint8_t>(writer, value); }
+// Pointers would otherwise silently convert to bool.
+template <class T>
+void cache_write(parse_cache_writer_t* writer, const T* value) = delete;
+void cache_write_size(parse_cache_writer_t* writer, size_t value) {
+    cache_write_raw<uint32_t>(writer, (uint32_t)value);
+}
+
+void cache_write(parse_cache_writer_t* writer, string_view str) {
+    auto contents = writer->contents;
+    if (str.data() && str.data() >= contents.data() && str.data() + str.size() <= contents.data() + contents.size()) {
+        cache_write(writer, true);
+        cache_write_size(writer, (size_t)(str.data() - contents.data()));
+        cache_write_size(writer, str.size());
+    } else {
+        cache_write(writer, false);
+        cache_write_size(writer, str.size());
+        writer->buffer.append(str.data(), str.size());
+    }
+}
+void cache_write(parse_cache_writer_t* writer, stream_loc_t location) {
+    if (location.file_index == writer->file_index) location.file_index = -1;
+    cache_write_raw(writer, location);
+}
+void cache_write(parse_cache_writer_t* writer, const string_token& token) {
+    cache_write(writer, token.contents);
+    cache_write(writer, token.location);
+    // Interned again on load, see read_identifier_id.
+    assert(token.identifier_id < 0 || token.identifier_id == find_identifier(token.contents));
+    cache_write(writer, token.identifier_id >= 0);
+}
+
+void cache_write(parse_cache_writer_t* writer, const unique_expression_t& exp);
+void cache_write(parse_cache_writer_t* writer, const vector<unique_expression_t>& expressions) {
+    cache_write_size(writer, expressions.size());
+    for (auto& exp : expressions) {
+        cache_write(writer, exp);
+    }
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_identifier_t* exp) {
+    cache_write(writer, exp->identifier);
+    cache_write(writer, exp->identifier_id >= 0);
+    if (exp->symbol) writer->valid = false;
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_constant_t* exp) {
+    cache_write(writer, exp->contents);
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_one_t* exp) {
+    cache_write(writer, exp->child);
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_two_t* exp) {
+    cache_write(writer, exp->lhs);
+    cache_write(writer, exp->rhs);
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_subscript_t* exp) {
+    cache_write(writer, exp->lhs);
+    cache_write(writer, exp->rhs);
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_call_t* exp) {
+    cache_write(writer, exp->lhs);
+    cache_write(writer, exp->arguments);
+    if (exp->method) writer->valid = false;
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_dot_t* exp) {
+    cache_write(writer, exp->lhs);
+    cache_write_size(writer, exp->fields.size());
+    for (auto& field : exp->fields) {
+        cache_write(writer, field);
+    }
+    if (!exp->inferred.empty()) writer->valid = false;
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_list_t* exp) {
+    cache_write(writer, exp->entries);
+}
+void cache_write_concrete(parse_cache_writer_t* writer, const expression_compile_time_evaluated_t*) {
+    // Only created by type inference.
+    writer->valid = false;
+}
+
+void cache_write(parse_cache_writer_t* writer, const unique_expression_t& exp) {
+    cache_write(writer, (bool)exp);
+    if (!exp) return;
+
+    auto p = exp.get();
+    cache_write_raw(writer, p->type);
+    cache_write_raw(writer, p->value_category);
+    cache_write_raw(writer, p->result_type);
+    cache_write(writer, (stream_loc_t)p->location);
+    cache_write(writer, p->location.length);
+    if (p->definition) writer->valid = false;
+    visit_expression(p, [writer](auto* concrete) { cache_write_concrete(writer, concrete); });
+}
+
+void cache_write(parse_cache_writer_t* writer, const literal_block_t& block);
+void cache_write(parse_cache_writer_t* writer, const stmt_declaration_t& declaration) {
+    cache_write(writer, declaration.variable);
+    cache_write_raw(writer, declaration.type);
+    cache_write(writer, declaration.expression);
+    cache_write(writer, declaration.infer_type);
+}
+void cache_write(parse_cache_writer_t* writer, const statement_t& statement) {
+    cache_write(writer, (int)statement.type);
+    cache_write(writer, statement.spaces);
+    switch (statement.type) {
+        case stmt_none:
+        case stmt_return: {
+            break;
+        }
+        case stmt_literal: {
+            cache_write(writer, string_view{statement.literal});
+            break;
+        }
+        case stmt_if: {
+            auto& if_statement = statement.if_statement;
+            cache_write(writer, if_statement.condition);
+            cache_write(writer, if_statement.then_block);
+            cache_write(writer, if_statement.else_block);
+            cache_write(writer, if_statement.then_scope_index);
+            cache_write(writer, if_statement.else_scope_index);
+            break;
+        }
+        case stmt_for: {
+            auto& for_statement = statement.for_statement;
+            cache_write(writer, for_statement.variable);
+            cache_write(writer, for_statement.variable_id >= 0);
+            cache_write(writer, for_statement.container_expression);
+            cache_write(writer, for_statement.body);
+            cache_write(writer, for_statement.scope_index);
+            break;
+        }
+        case stmt_output: {
+            cache_write(writer, statement.output_statement.path_expression);
+            cache_write(writer, statement.output_statement.body);
+            cache_write(writer, statement.output_statement.scope_index);
+            break;
+        }
+        case stmt_expression: {
+            cache_write(writer, statement.formatted.expression);
+            cache_write_raw(writer, statement.formatted.format);
+            break;
+        }
+        case stmt_comma: {
+            cache_write(writer, statement.comma.index);
+            cache_write(writer, statement.comma.space_after);
+            break;
+        }
+        case stmt_declaration: {
+            cache_write(writer, statement.declaration);
+            break;
+        }
+        case stmt_break:
+        case stmt_continue: {
+            cache_write(writer, statement.break_continue_statement.level);
+            break;
+        }
+    }
+}
+void cache_write(parse_cache_writer_t* writer, const formatted_segment_t& segment) {
+    cache_write_raw(writer, segment.whitespace);
+    cache_write_size(writer, segment.statements.size());
+    for (auto& statement : segment.statements) {
+        cache_write(writer, statement);
+    }
+}
+void cache_write(parse_cache_writer_t* writer, const literal_block_t& block) {
+    cache_write_size(writer, block.segments.size());
+    for (auto& segment : block.segments) {
+        cache_write(writer, segment);
+    }
+    cache_write(writer, block.has_output);
+    cache_write(writer, block.valid);
+    cache_write(writer, block.finalized);
+}
+
+void cache_write(parse_cache_writer_t* writer, const match_type_definition_t* definition) {
+    cache_write(writer, definition->name);
+    cache_write(writer, (int)definition->type);
+    if (definition->finalized) writer->valid = false;
+    switch (definition->type) {
+        case td_pattern: {
+            auto& pattern = definition->pattern;
+            cache_write_size(writer, pattern.fields.size());
+            for (auto& field : pattern.fields) {
+                cache_write(writer, field.name);
+                cache_write(writer, field.match_index);
+            }
+            cache_write_size(writer, pattern.match_entries.size());
+            for (auto& entry : pattern.match_entries) {
+                cache_write(writer, (int)entry.type);
+                // Custom types are resolved by name when processing.
+                if (entry.type == mt_custom) {
+                    if (entry.match.custom) writer->valid = false;
+                } else {
+                    cache_write_raw(writer, entry.match.type);
+                }
+                cache_write(writer, entry.type_name);
+                cache_write(writer, string_view{entry.contents});
+                cache_write(writer, entry.location);
+                cache_write_raw(writer, entry.word_range);
+            }
+            break;
+        }
+        case td_sum: {
+            auto& sum = definition->sum;
+            cache_write_size(writer, sum.names.size());
+            for (auto& name : sum.names) {
+                cache_write(writer, name);
+            }
+            if (!sum.entries.empty()) writer->valid = false;
+            break;
+        }
+        default: {
+            writer->valid = false;
+            break;
+        }
+    }
+}
+
+void cache_write(parse_cache_writer_t* writer, const generator_t* generator) {
+    cache_write(writer, generator->name);
+    cache_write(writer, generator->location);
+    cache_write_size(writer, generator->parameters.size());
+    for (auto& parameter : generator->parameters) {
+        cache_write(writer, parameter);
+    }
+    cache_write(writer, generator->required_parameters);
+    cache_write(writer, generator->body);
+    cache_write(writer, generator->scope_index);
+    cache_write(writer, generator->stack_size);
+    if (generator->finalized) writer->valid = false;
+}
+
+enum cached_symbol_link_enum : uint8_t { csl_none, csl_definition, csl_generator };
+
+void cache_write(parse_cache_writer_t* writer, const symbol_entry_t* symbol) {
+    // Interned again on load, see cache_read_symbol.
+    assert(symbol->name_id == find_identifier(symbol->name.contents));
+    cache_write(writer, symbol->name);
+    cache_write(writer, symbol->match_type_definition_name);
+    cache_write_raw(writer, symbol->type);
+    // Only one of definition and generator is set, depending on the type of the symbol.
+    auto link = csl_none;
+    int link_index = -1;
+    if (symbol->type.id == tid_generator && symbol->generator) {
+        auto it = writer->generator_indices.find(symbol->generator);
+        if (it == writer->generator_indices.end()) {
+            writer->valid = false;
+        } else {
+            link = csl_generator;
+            link_index = it->second;
+        }
+    } else if (symbol->definition) {
+        auto it = writer->definition_indices.find(symbol->definition);
+        if (it == writer->definition_indices.end()) {
+            writer->valid = false;
+        } else {
+            link = csl_definition;
+            link_index = it->second;
+        }
+    }
+    cache_write_raw(writer, link);
+    cache_write(writer, link_index);
+    cache_write(writer, symbol->stack_value_index);
+    cache_write(writer, symbol->declaration_inferred);
+}
+
+// Reading
+
+struct parse_cache_reader_t {
+    const char* cur = nullptr;
+    const char* end = nullptr;
+    string_view contents;
+    int file_index = -1;
+    parsed_state_t* parsed = nullptr;
+    bool valid = true;
+};
+
+template <class T>
+T cache_read_raw(parse_cache_reader_t* reader) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T result = {};
+    if ((size_t)(reader->end - reader->cur) < sizeof(T)) {
+        reader->valid = false;
+        return result;
+    }
+    memcpy(&result, reader->cur, sizeof(T));
+    reader->cur += sizeof(T);
+    return result;
+}
+int cache_read_int(parse_cache_reader_t* reader) { return cache_read_raw<int32_t>(reader); }
+bool cache_read_bool(parse_cache_reader_t* reader) { return cache_read_raw<uint8_t>(reader) != 0; }
+// Number of entries that follow, each entry takes at least one byte.
+size_t cache_read_count(parse_cache_reader_t* reader) {
+    size_t count = cache_read_raw<uint32_t>(reader);
+    if (count > (size_t)(reader->end - reader->cur)) {
+        reader->valid = false;
+        return 0;
+    }
+    return count;
+}
+
+string_view cache_read_string(parse_cache_reader_t* reader) {
+    auto contents = reader->contents;
+    if (cache_read_bool(reader)) {
+        size_t offset = cache_read_raw<uint32_t>(reader);
+        size_t size = cache_read_raw<uint32_t>(reader);
+        if (offset > contents.size() || size > contents.size() - offset) {
+            reader->valid = false;
+            return {};
+        }
+        return {contents.data() + offset, size};
+    }
+
+    auto size = cache_read_count(reader);
+    if (!size) return {};
+    auto persistent = monotonic_new_array<char>(size);
+    memcpy(persistent, reader->cur, size);
+    reader->cur += size;
+    return {persistent, size};
+}
+stream_loc_t cache_read_location(parse_cache_reader_t* reader) {
+    auto location = cache_read_raw<stream_loc_t>(reader);
+    if (location.file_index == -1) location.file_index = reader->file_index;
+    return location;
+}
+int read_identifier_id(parse_cache_reader_t* reader, string_view identifier) {
+    return cache_read_bool(reader) ? intern_identifier(identifier) : -1;
+}
+string_token cache_read_token(parse_cache_reader_t* reader) {
+    string_token result;
+    result.contents = cache_read_string(reader);
+    result.location = cache_read_location(reader);
+    result.identifier_id = read_identifier_id(reader, result.contents);
+    return result;
+}
+
+unique_expression_t make_expression_of_type(expression_type_enum type, stream_loc_ex_t location) {
+    // clang-format off
+    switch (type) {
+        case exp_identifier:  return make_expression<exp_identifier>(location);
+        case exp_constant:    return make_expression<exp_constant>(location);
+        case exp_array:       return make_expression<exp_array>(location);
+        case exp_call:        return make_expression<exp_call>(location);
+        case exp_instanceof:  return make_expression<exp_instanceof>(location);
+        case exp_subscript:   return make_expression<exp_subscript>(location);
+        case exp_dot:         return make_expression<exp_dot>(location);
+        case exp_unary_plus:  return make_expression<exp_unary_plus>(location);
+        case exp_unary_minus: return make_expression<exp_unary_minus>(location);
+        case exp_not:         return make_expression<exp_not>(location);
+        case exp_mul:         return make_expression<exp_mul>(location);
+        case exp_div:         return make_expression<exp_div>(location);
+        case exp_mod:         return make_expression<exp_mod>(location);
+        case exp_add:         return make_expression<exp_add>(location);
+        case exp_sub:         return make_expression<exp_sub>(location);
+        case exp_lt:          return make_expression<exp_lt>(location);
+        case exp_lte:         return make_expression<exp_lte>(location);
+        case exp_gt:          return make_expression<exp_gt>(location);
+        case exp_gte:         return make_expression<exp_gte>(location);
+        case exp_eq:          return make_expression<exp_eq>(location);
+        case exp_neq:         return make_expression<exp_neq>(location);
+        case exp_and:         return make_expression<exp_and>(location);
+        case exp_or:          return make_expression<exp_or>(location);
+        case exp_assign:      return make_expression<exp_assign>(location);
+        default:              return {};
+    }
+    // clang-format on
+}
+
+unique_expression_t cache_read_expression(parse_cache_reader_t* reader);
+void cache_read_expressions(parse_cache_reader_t* reader, vector<unique_expression_t>* out) {
+    auto count = cache_read_count(reader);
+    out->reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        out->push_back(cache_read_expression(reader));
+    }
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_identifier_t* exp) {
+    exp->identifier = cache_read_string(reader);
+    exp->identifier_id = read_identifier_id(reader, exp->identifier);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_constant_t* exp) {
+    exp->contents = cache_read_string(reader);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_one_t* exp) {
+    exp->child = cache_read_expression(reader);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_two_t* exp) {
+    exp->lhs = cache_read_expression(reader);
+    exp->rhs = cache_read_expression(reader);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_subscript_t* exp) {
+    exp->lhs = cache_read_expression(reader);
+    exp->rhs = cache_read_expression(reader);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_call_t* exp) {
+    exp->lhs = cache_read_expression(reader);
+    cache_read_expressions(reader, &exp->arguments);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_dot_t* exp) {
+    exp->lhs = cache_read_expression(reader);
+    auto count = cache_read_count(reader);
+    exp->fields.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        exp->fields.push_back(cache_read_token(reader));
+    }
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_list_t* exp) {
+    cache_read_expressions(reader, &exp->entries);
+}
+void cache_read_concrete(parse_cache_reader_t* reader, expression_compile_time_evaluated_t*) {
+    // Never written, see make_expression_of_type.
+    reader->valid = false;
+}
+
+unique_expression_t cache_read_expression(parse_cache_reader_t* reader) {
+    if (!cache_read_bool(reader)) return {};
+
+    auto type = cache_read_raw<expression_type_enum>(reader);
+    auto value_category = cache_read_raw<exp_value_category_enum>(reader);
+    auto result_type = cache_read_raw<typeid_info>(reader);
+    stream_loc_ex_t location;
+    static_cast<stream_loc_t&>(location) = cache_read_location(reader);
+    location.length = cache_read_int(reader);
+
+    auto result = make_expression_of_type(type, location);
+    if (!result) {
+        reader->valid = false;
+        return {};
+    }
+    result->value_category = value_category;
+    result->result_type = result_type;
+    visit_expression(result.get(), [reader](auto* concrete) { cache_read_concrete(reader, concrete); });
+    return result;
+}
+
+void cache_read_block(parse_cache_reader_t* reader, literal_block_t* out);
+void cache_read_declaration(parse_cache_reader_t* reader, stmt_declaration_t* out) {
+    out->variable = cache_read_token(reader);
+    out->type = cache_read_raw<typeid_info>(reader);
+    out->expression = cache_read_expression(reader);
+    out->infer_type = cache_read_bool(reader);
+}
+void cache_read_statement(parse_cache_reader_t* reader, statement_t* out) {
+    auto type = cache_read_int(reader);
+    if (type < stmt_none || type > stmt_output) {
+        reader->valid = false;
+        return;
+    }
+    out->set_type((statement_type_enum)type);
+    out->spaces = cache_read_int(reader);
+    switch (out->type) {
+        case stmt_none:
+        case stmt_return: {
+            break;
+        }
+        case stmt_literal: {
+            auto literal = cache_read_string(reader);
+            out->literal.assign(literal.data(), literal.size());
+            break;
+        }
+        case stmt_if: {
+            auto& if_statement = out->if_statement;
+            if_statement.condition = cache_read_expression(reader);
+            cache_read_block(reader, &if_statement.then_block);
+            cache_read_block(reader, &if_statement.else_block);
+            if_statement.then_scope_index = cache_read_int(reader);
+            if_statement.else_scope_index = cache_read_int(reader);
+            break;
+        }
+        case stmt_for: {
+            auto& for_statement = out->for_statement;
+            for_statement.variable = cache_read_string(reader);
+            for_statement.variable_id = read_identifier_id(reader, for_statement.variable);
+            for_statement.container_expression = cache_read_expression(reader);
+            cache_read_block(reader, &for_statement.body);
+            for_statement.scope_index = cache_read_int(reader);
+            break;
+        }
+        case stmt_output: {
+            out->output_statement.path_expression = cache_read_expression(reader);
+            cache_read_block(reader, &out->output_statement.body);
+            out->output_statement.scope_index = cache_read_int(reader);
+            break;
+        }
+        case stmt_expression: {
+            out->formatted.expression = cache_read_expression(reader);
+            out->formatted.format = cache_read_raw<PrintFormat>(reader);
+            break;
+        }
+        case stmt_comma: {
+            out->comma.index = cache_read_int(reader);
+            out->comma.space_after = cache_read_bool(reader);
+            break;
+        }
+        case stmt_declaration: {
+            cache_read_declaration(reader, &out->declaration);
+            break;
+        }
+        case stmt_break:
+        case stmt_continue: {
+            out->break_continue_statement.level = cache_read_int(reader);
+            break;
+        }
+    }
+}
+void cache_read_segment(parse_cache_reader_t* reader, formatted_segment_t* out) {
+    out->whitespace = cache_read_raw<whitespace_state>(reader);
+    auto count = cache_read_count(reader);
+    out->statements.resize(count);
+    for (auto& statement : out->statements) {
+        cache_read_statement(reader, &statement);
+    }
+}
+void cache_read_block(parse_cache_reader_t* reader, literal_block_t* out) {
+    auto count = cache_read_count(reader);
+    out->segments.resize(count);
+    for (auto& segment : out->segments) {
+        cache_read_segment(reader, &segment);
+    }
+    out->has_output = cache_read_bool(reader);
+    out->valid = cache_read_bool(reader);
+    out->finalized = cache_read_bool(reader);
+}
+
+void cache_read_definition(parse_cache_reader_t* reader) {
+    auto name = cache_read_token(reader);
+    auto type = (match_type_definition_enum)cache_read_int(reader);
+    if (type != td_pattern && type != td_sum) {
+        reader->valid = false;
+        return;
+    }
+    // Symbols are read separately, so the definition isn't added with parsed_state_t::add_match_type_definition.
+    auto definition = reader->parsed->match_type_definitions
+                          .emplace_back(make_monotonic_unique<match_type_definition_t>(type))
+                          .get();
+    definition->name = name;
+    if (type == td_pattern) {
+        auto& pattern = definition->pattern;
+        pattern.fields.resize(cache_read_count(reader));
+        for (auto& field : pattern.fields) {
+            field.name = cache_read_string(reader);
+            field.match_index = cache_read_int(reader);
+        }
+        auto entry_count = cache_read_count(reader);
+        pattern.match_entries.reserve(entry_count);
+        for (size_t i = 0; i < entry_count; ++i) {
+            auto& entry = pattern.match_entries.emplace_back(type_match_entry{mt_word, nullptr, {}, {}, {}, 0, 0});
+            entry.type = (match_type)cache_read_int(reader);
+            if (entry.type == mt_custom) {
+                entry.match.custom = nullptr;
+            } else {
+                entry.match.type = cache_read_raw<typeid_info>(reader);
+            }
+            entry.type_name = cache_read_string(reader);
+            auto contents = cache_read_string(reader);
+            entry.contents.assign(contents.data(), contents.size());
+            entry.location = cache_read_location(reader);
+            entry.word_range = cache_read_raw<word_range_t>(reader);
+        }
+    } else {
+        auto& sum = definition->sum;
+        auto count = cache_read_count(reader);
+        sum.names.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            sum.names.push_back(cache_read_token(reader));
+        }
+    }
+}
+
+void cache_read_generator(parse_cache_reader_t* reader) {
+    auto generator = reader->parsed->generators.emplace_back(make_monotonic_unique<generator_t>()).get();
+    generator->name = cache_read_token(reader);
+    generator->location = cache_read_location(reader);
+    generator->parameters.resize(cache_read_count(reader));
+    for (auto& parameter : generator->parameters) {
+        cache_read_declaration(reader, &parameter);
+    }
+    generator->required_parameters = cache_read_int(reader);
+    cache_read_block(reader, &generator->body);
+    generator->scope_index = cache_read_int(reader);
+    generator->stack_size = cache_read_int(reader);
+}
+
+void cache_read_symbol(parse_cache_reader_t* reader, symbol_table_t* table) {
+    auto parsed = reader->parsed;
+    symbol_entry_t symbol = {};
+    symbol.name = cache_read_token(reader);
+    symbol.name_id = intern_identifier(symbol.name.contents);
+    symbol.match_type_definition_name = cache_read_token(reader);
+    symbol.type = cache_read_raw<typeid_info>(reader);
+    auto link = cache_read_raw<cached_symbol_link_enum>(reader);
+    auto link_index = cache_read_int(reader);
+    switch (link) {
+        case csl_none: {
+            break;
+        }
+        case csl_definition: {
+            if (link_index < 0 || link_index >= (int)parsed->match_type_definitions.size()) {
+                reader->valid = false;
+                return;
+            }
+            symbol.definition = parsed->match_type_definitions[link_index].get();
+            break;
+        }
+        case csl_generator: {
+            if (link_index < 0 || link_index >= (int)parsed->generators.size()) {
+                reader->valid = false;
+                return;
+            }
+            symbol.generator = parsed->generators[link_index].get();
+            break;
+        }
+        default: {
+            reader->valid = false;
+            return;
+        }
+    }
+    symbol.stack_value_index = cache_read_int(reader);
+    symbol.declaration_inferred = cache_read_bool(reader);
+    if (reader->valid) table->add(symbol);
+}
+
+// Cache files
+
+bool store_cached_file(const parsed_state_t* parsed, string_view directory, int file_index) {
+    auto& file = parsed->source_files[file_index];
+    assert(file.parsed);
+
+    parse_cache_writer_t writer;
+    writer.contents = file.contents;
+    writer.file_index = file_index;
+    for (int i = 0, count = (int)parsed->match_type_definitions.size(); i < count; ++i) {
+        writer.definition_indices[parsed->match_type_definitions[i].get()] = i;
+    }
+    for (int i = 0, count = (int)parsed->generators.size(); i < count; ++i) {
+        writer.generator_indices[parsed->generators[i].get()] = i;
+    }
+
+    cache_write(&writer, parsed->toplevel_stack_size);
+    cache_write_size(&writer, parsed->match_type_definitions.size());
+    for (auto& definition : parsed->match_type_definitions) {
+        cache_write(&writer, definition.get());
+    }
+    cache_write_size(&writer, parsed->generators.size());
+    for (auto& generator : parsed->generators) {
+        cache_write(&writer, generator.get());
+    }
+    cache_write_size(&writer, parsed->symbol_tables.size());
+    for (size_t i = 0, count = parsed->symbol_tables.size(); i < count; ++i) {
+        auto& table = parsed->symbol_tables[i];
+        // The first global of every parsed state is the builtin argv, which isn't stored.
+        size_t first = (i == 0) ? 1 : 0;
+        cache_write(&writer, table.parent_symbol_table_index);
+        cache_write_size(&writer, table.symbols.size() - first);
+        for (size_t j = first, symbol_count = table.symbols.size(); j < symbol_count; ++j) {
+            cache_write(&writer, table.symbols[j].get());
+        }
+    }
+    cache_write(&writer, parsed->toplevel_segment);
+    if (!writer.valid) return false;
+
+    parse_cache_header_t header = {};
+    memcpy(header.magic, parse_cache_magic, sizeof(header.magic));
+    header.version = parse_cache_version;
+    memcpy(header.layout, parse_cache_layout, sizeof(header.layout));
+    header.file_index = file_index;
+    header.contents_size = file.contents.size();
+    header.contents_hash = hash_contents(file.contents);
+    header.body_size = writer.buffer.size();
+
+    // The same file written concurrently by another invocation has the same contents. Reading it while it is being
+    // written fails the size check when loading.
+    auto path = cached_file_path(directory, header.contents_hash);
+    FILE* out = tmu_fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool result = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  fwrite(writer.buffer.data(), 1, writer.buffer.size(), out) == writer.buffer.size();
+    fclose(out);
+    return result;
+}
+
+// Loads the parsed file at file_index from the cache, the contents of the file have to be loaded already. Returns false
+// if the file isn't cached. Parsed is left in an unspecified state if loading fails after reading the cached file.
+bool load_cached_file(parsed_state_t* parsed, string_view directory, int file_index) {
+    auto& file = parsed->source_files[file_index];
+    assert(!file.parsed && file.contents.data());
+
+    auto contents_hash = hash_contents(file.contents);
+    auto path = cached_file_path(directory, contents_hash);
+    FILE* in = tmu_fopen(path.c_str(), "rb");
+    if (!in) return false;
+    parse_cache_header_t header = {};
+    std::string body;
+    bool read = fread(&header, sizeof(header), 1, in) == 1 &&
+                memcmp(header.magic, parse_cache_magic, sizeof(header.magic)) == 0 &&
+                header.version == parse_cache_version &&
+                memcmp(header.layout, parse_cache_layout, sizeof(header.layout)) == 0 &&
+                header.contents_size == file.contents.size() && header.contents_hash == contents_hash &&
+                header.body_size < (1ull << 32);
+    if (read) {
+        body.resize((size_t)header.body_size);
+        // Reading one more byte than expected detects files that are longer than the header says.
+        read = fread(body.data(), 1, body.size(), in) == body.size() && fgetc(in) == EOF;
+    }
+    fclose(in);
+    if (!read) return false;
+
+    parse_cache_reader_t reader;
+    reader.cur = body.data();
+    reader.end = body.data() + body.size();
+    reader.contents = file.contents;
+    reader.file_index = file_index;
+    reader.parsed = parsed;
+
+    parsed->toplevel_stack_size = cache_read_int(&reader);
+    for (size_t i = 0, count = cache_read_count(&reader); i < count && reader.valid; ++i) {
+        cache_read_definition(&reader);
+    }
+    for (size_t i = 0, count = cache_read_count(&reader); i < count && reader.valid; ++i) {
+        cache_read_generator(&reader);
+    }
+    auto table_count = cache_read_count(&reader);
+    if (table_count < 1) return false;
+    for (size_t i = 0; i < table_count && reader.valid; ++i) {
+        auto parent = cache_read_int(&reader);
+        if (i > 0) parsed->symbol_tables.emplace_back(parent);
+        auto table = &parsed->symbol_tables[i];
+        for (size_t j = 0, count = cache_read_count(&reader); j < count && reader.valid; ++j) {
+            cache_read_symbol(&reader, table);
+        }
+    }
+    cache_read_segment(&reader, &parsed->toplevel_segment);
+    if (!reader.valid || reader.cur != reader.end) return false;
+
+    parsed->valid = true;
+    file.parsed = true;
+    return true;
+}
@@ -199,6 +199,7 @@ parse_result parse_identifier_expression(tokenizer_t* tokenizer, unique_expressi
         auto ast = make_expression<exp_identifier>(token);
         auto ast_ptr = ast.get();
         ast_ptr->identifier = token.contents;
+        ast_ptr->identifier_id = token.identifier_id;
         // We can't determine value category yet, because symbols can't be resolved at this stage yet.
         ast_ptr->value_category = exp_value_runtime;  // Defaults to runtime category.
 
@@ -0,0 +1,224 @@
+/*
+Parsing of many independent files, like the .tg/ folders and -I directories. Files are parsed concurrently into
+fragments, each with its own parsed_state_t and allocator, which are then merged in the original file order. The result
+is the same as parsing the files one after another with parse_file.
+
+Fragments can't resolve include statements, since includes have to be parsed in place and only once. Fragments that
+contain includes or fail to parse are dropped and their file is parsed again on the main thread, which also reports
+errors in order.
+
+With a cache directory (see parse_cache.cpp), fragments are loaded from the cache if their file is unchanged and stored
+in it after parsing otherwise.
+*/
+
+struct parsed_fragment_t {
+    monotonic_block_allocator allocator;
+    unique_ptr<parsed_state_t> parsed;
+    bool valid = false;
+    bool cached = false;  // Loaded from the cache instead of being parsed.
+};
+
+void parse_fragment(parsed_fragment_t* fragment, const file_data& file, string_view cache_directory) {
+    monotonic_allocator_scope_t allocator_scope{&fragment->allocator};
+    auto make_parsed = [fragment, &file]() {
+        fragment->parsed = std::make_unique<parsed_state_t>();
+        auto parsed = fragment->parsed.get();
+        // Same file index as in the merged state, so that token locations don't have to be remapped.
+        parsed->source_files.resize(file.index + 1);
+        parsed->source_files[file.index] = file;
+        return parsed;
+    };
+    auto parsed = make_parsed();
+    if (!load_source_file(parsed, file.index)) return;
+
+    auto contents = parsed->source_files[file.index].contents;
+    if (!cache_directory.empty()) {
+        if (load_cached_file(parsed, cache_directory, file.index)) {
+            fragment->valid = true;
+            fragment->cached = true;
+            return;
+        }
+        // Loading may have failed halfway through, start over with the already loaded contents.
+        parsed = make_parsed();
+        parsed->source_files[file.index].contents = contents;
+    }
+
+    parsed_state_scope_t parsed_scope{parsed};
+    parsing_state_t parsing = {parsed};
+    parsing.is_fragment = true;
+    parsing.current_stack_size = parsed->toplevel_stack_size;
+    fragment->valid = parse_contents(&parsing, file.index);
+    parsed->toplevel_stack_size = parsing.current_stack_size;
+    if (fragment->valid && !cache_directory.empty()) store_cached_file(parsed, cache_directory, file.index);
+}
+
+void offset_scope_indices(formatted_segment_t* segment, int symbol_table_offset);
+void offset_scope_indices(literal_block_t* block, int symbol_table_offset) {
+    for (auto& segment : block->segments) {
+        offset_scope_indices(&segment, symbol_table_offset);
+    }
+}
+void offset_scope_indices(formatted_segment_t* segment, int symbol_table_offset) {
+    // Global symbol table 0 is shared by all fragments, only nested tables move.
+    auto offset = [symbol_table_offset](int* index) {
+        if (*index > 0) *index += symbol_table_offset;
+    };
+    for (auto& statement : segment->statements) {
+        switch (statement.type) {
+            case stmt_if: {
+                offset(&statement.if_statement.then_scope_index);
+                offset(&statement.if_statement.else_scope_index);
+                offset_scope_indices(&statement.if_statement.then_block, symbol_table_offset);
+                offset_scope_indices(&statement.if_statement.else_block, symbol_table_offset);
+                break;
+            }
+            case stmt_for: {
+                offset(&statement.for_statement.scope_index);
+                offset_scope_indices(&statement.for_statement.body, symbol_table_offset);
+                break;
+            }
+            case stmt_output: {
+                offset(&statement.output_statement.scope_index);
+                offset_scope_indices(&statement.output_statement.body, symbol_table_offset);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+// Moves everything the fragment parsed into parsed. Returns false without changing parsed, if a global symbol of the
+// fragment conflicts with one that is already defined.
+bool merge_fragment(parsed_state_t* parsed, parsed_fragment_t* fragment, int file_index) {
+    auto source = fragment->parsed.get();
+    auto& source_globals = source->symbol_tables[0].symbols;
+
+    // The first global of every parsed state is the builtin argv.
+    assert(!source_globals.empty() && source_globals[0]->name.contents == "argv");
+    for (size_t i = 1, count = source_globals.size(); i < count; ++i) {
+        if (parsed->symbol_tables[0].find(source_globals[i]->name_id)) return false;
+    }
+
+    // Toplevel variables are placed on the stack after those of previous files. Generators have their own stack.
+    int stack_offset = parsed->toplevel_stack_size - 1;
+    int symbol_table_offset = (int)parsed->symbol_tables.size() - 1;
+    auto offset_stack_index = [stack_offset](symbol_entry_t* symbol) {
+        if (symbol->stack_value_index >= 0) symbol->stack_value_index += stack_offset;
+    };
+
+    vector<bool> in_generator(source->symbol_tables.size(), false);
+    for (auto& generator : source->generators) {
+        in_generator[generator->scope_index] = true;
+    }
+    for (size_t i = 1, count = source->symbol_tables.size(); i < count; ++i) {
+        auto& table = source->symbol_tables[i];
+        // Parents are always added before their children.
+        assert(table.parent_symbol_table_index >= 0 && (size_t)table.parent_symbol_table_index < i);
+        if (in_generator[table.parent_symbol_table_index]) in_generator[i] = true;
+        if (!in_generator[i]) {
+            for (auto& symbol : table.symbols) {
+                offset_stack_index(symbol.get());
+            }
+        }
+        if (table.parent_symbol_table_index > 0) table.parent_symbol_table_index += symbol_table_offset;
+        parsed->symbol_tables.push_back(move(table));
+    }
+
+    auto& globals = parsed->symbol_tables[0];
+    for (size_t i = 1, count = source_globals.size(); i < count; ++i) {
+        offset_stack_index(source_globals[i].get());
+        globals.add(move(source_globals[i]));
+    }
+
+    for (auto& generator : source->generators) {
+        generator->scope_index += symbol_table_offset;
+        offset_scope_indices(&generator->body, symbol_table_offset);
+        parsed->generators.push_back(move(generator));
+    }
+    for (auto& definition : source->match_type_definitions) {
+        parsed->match_type_definitions.push_back(move(definition));
+    }
+
+    offset_scope_indices(&source->toplevel_segment, symbol_table_offset);
+    auto& statements = parsed->toplevel_segment.statements;
+    statements.insert(statements.end(), std::make_move_iterator(source->toplevel_segment.statements.begin()),
+                      std::make_move_iterator(source->toplevel_segment.statements.end()));
+
+    parsed->toplevel_stack_size += source->toplevel_stack_size - 1;
+    parsed->source_files[file_index] = source->source_files[file_index];
+    parsed->valid = true;
+    return true;
+}
+
+// Parses files in order, as if parse_file was called for each of them.
+bool parse_files(parsed_state_t* parsed, const vector<std::string>& filenames) {
+    assert(parsed);
+
+    auto thread_count = min<size_t>(filenames.size(), max(std::thread::hardware_concurrency(), 1u));
+    // Only fragments are cached, so a single file is parsed as a fragment too if there is a cache.
+    if (thread_count <= 1 && parsed->cache_directory.empty()) {
+        for (auto& filename : filenames) {
+            if (!parse_file(parsed, filename)) return false;
+        }
+        return true;
+    }
+
+    // Files are added up front, so that they keep the same index in fragments.
+    int first_file_index = (int)parsed->source_files.size();
+    for (auto& filename : filenames) {
+        add_source_file(parsed, filename);
+    }
+
+    vector<parsed_fragment_t> fragments(filenames.size());
+    std::mutex identifiers_mutex;
+    auto identifiers = parsed->identifiers;
+    string_view cache_directory = parsed->cache_directory;
+    std::atomic<size_t> next_fragment = {0};
+    auto parse_fragments = [&]() {
+        identifier_cache_t cache;
+        cache.shared = identifiers;
+        cache.shared_mutex = &identifiers_mutex;
+        current_identifier_cache = &cache;
+        suppress_error_output = true;
+        for (auto i = next_fragment++; i < fragments.size(); i = next_fragment++) {
+            parse_fragment(&fragments[i], parsed->source_files[first_file_index + i], cache_directory);
+        }
+        suppress_error_output = false;
+        current_identifier_cache = nullptr;
+    };
+
+    // The calling thread parses files too.
+    vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(parse_fragments);
+    }
+    parse_fragments();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool result = true;
+    for (size_t i = 0, count = fragments.size(); i < count; ++i) {
+        auto fragment = &fragments[i];
+        int file_index = first_file_index + (int)i;
+        parsed->allocator->adopt(move(fragment->allocator));
+        if (result) {
+            if (fragment->valid && merge_fragment(parsed, fragment, file_index)) {
+                if (parsed->verbose) {
+                    auto filename = parsed->source_files[file_index].filename;
+                    if (fragment->cached) {
+                        print(stdout, "Loading \"{}\" from cache.\n", filename);
+                    } else {
+                        print(stdout, "Parsing \"{}\".\n", filename);
+                    }
+                }
+            } else {
+                result = parse_added_file(parsed, file_index);
+            }
+        }
+        fragment->parsed.reset();
+    }
+    return result;
+}
@@ -121,160 +121,177 @@ const char* string_match_get_end_of_expression(const char* current) {
 bool string_match_definition(const match_type_definition_t& definition, string_matcher* matcher, any_t* out,
                              bool print_error = true);
 
-bool string_match_pattern(const match_type_definition_t& definition, string_matcher* matcher, any_t* out,
-                          bool print_error = true) {
-    assert(definition.type == td_pattern);
-    assert(matcher);
-    assert(out);
-
-    auto match = &out->to_pattern();
-    match->definition = &definition;
-
+// Matches the entries of a pattern once. Entries of type mt_word match as many words as their range allows, ranges
+// are narrowed to the number of words that were matched and words_matched is set to the number of mt_word entries
+// that matched, so that string_match_pattern can retry. Without word_ranges the precomputed ranges of the pattern are
+// used and not narrowed.
+bool string_match_pattern_entries(const match_type_definition_t& definition, string_matcher* matcher,
+                                  matched_pattern_instance_t* match, word_range_t* word_ranges, size_t* words_matched,
+                                  bool print_error) {
     auto pattern = &definition.pattern;
-
-    skip_whitespace(matcher);
-
     auto last = matcher->current_file.contents.end();
-
-    vector<word_range_t> word_ranges;
-    word_ranges.reserve(pattern->match_entries.size());
-    for (auto& entry : pattern->match_entries) {
-        if (entry.type == mt_word) {
-            word_ranges.push_back(entry.word_range);
-        }
-    }
-
-    auto local_print_error = print_error;
-    if (word_ranges.size()) local_print_error = false;
-
-    auto backup = get_state(matcher);
     auto& match_entries = pattern->match_entries;
     size_t entries_count = match_entries.size();
-    for (bool not_parsed = true; not_parsed;) {
-        not_parsed = false;
-        size_t current_range = 0;
-        match->field_values.clear();
+    size_t current_range = 0;
+    match->field_values.clear();
+    if (words_matched) *words_matched = 0;
 
-        for (size_t entry_index = 0; entry_index < entries_count; ++entry_index) {
-            auto& entry = match_entries[entry_index];
+    for (size_t entry_index = 0; entry_index < entries_count; ++entry_index) {
+        auto& entry = match_entries[entry_index];
 
-            skip_whitespace(matcher);
-            switch (entry.type) {
-                case mt_word: {
-                    auto location = matcher->location;
-                    auto start = matcher->current;
+        skip_whitespace(matcher);
+        switch (entry.type) {
+            case mt_word: {
+                auto location = matcher->location;
+                auto start = matcher->current;
 
-                    auto& range = word_ranges[current_range++];
-                    int16_t max_count = range.max;
-                    if (max_count < 0) max_count = INT16_MAX / 2;
-                    assert(range.min >= 0);
-                    int iterations = (int)max_count - (int)range.min;
-                    string value;
-                    int16_t words_detected = 0;
-                    for (int i = 0; i < iterations; ++i) {
-                        auto current = matcher->current;
-                        auto word_end = tmsu_find_first_of_v(tmsu_view_n(current, last), WHITESPACE);
-                        if (current != word_end) {
-                            if (i != 0) value += ' ';
+                auto range = word_ranges ? word_ranges[current_range] : pattern->word_ranges[current_range];
+                // The maximum is exclusive.
+                int16_t max_count = range.max;
+                if (max_count < 0) max_count = INT16_MAX / 2;
+                assert(range.min >= 0);
+                int iterations = (int)max_count - 1;
+                // Single words are taken from the string directly, only multiple words are joined.
+                const char* first_word = start;
+                const char* first_word_end = start;
+                string value;
+                int16_t words_detected = 0;
+                for (int i = 0; i < iterations; ++i) {
+                    auto current = matcher->current;
+                    auto word_end = tmsu_find_first_of_v(tmsu_view_n(current, last), WHITESPACE);
+                    if (current != word_end) {
+                        if (words_detected == 0) {
+                            first_word = current;
+                            first_word_end = word_end;
+                        } else {
+                            if (words_detected == 1) value.assign(first_word, first_word_end);
+                            value += ' ';
                             value.insert(value.end(), current, word_end);
-                            ++words_detected;
-                        }
-                        advance_column(matcher, word_end);
-                        if (word_end == last) break;
-                        skip_whitespace(matcher);
-                    }
-                    if (words_detected < range.min) {
-                        if (local_print_error) {
-                            auto msg = print_string("Tokens do not match pattern: \"%.*s\".", PRINT_SW(entry.contents));
-                            print_error_type(string_match, msg, matcher, location, (int)(matcher->current - start));
-                            print_error_context("See definition for context.", {matcher->state, definition.name});
                         }
-                        not_parsed = true;
-                        break;
+                        ++words_detected;
                     }
-                    match->field_values.emplace_back(make_any(move(value)));
-                    range.max = words_detected + 1;
-                    break;
+                    advance_column(matcher, word_end);
+                    if (word_end == last) break;
+                    skip_whitespace(matcher);
                 }
-                case mt_type: {
-                    auto val = &match->field_values.emplace_back();
-                    switch (entry.match.type.id) {
-                        case tid_bool: {
-                            if (!string_match_bool(matcher, val, local_print_error)) not_parsed = true;
-                            break;
-                        }
-                        case tid_int: {
-                            if (!string_match_int(matcher, val, local_print_error)) not_parsed = true;
-                            break;
-                        }
-                        case tid_string: {
-                            if (!string_match_string(matcher, val, local_print_error)) not_parsed = true;
-                            break;
-                        }
-                        default: {
-                            assert(0 && "Invalid type id.");
-                            break;
-                        }
+                if (words_detected < range.min) {
+                    if (print_error) {
+                        auto msg = print_string("Tokens do not match pattern: \"%.*s\".", PRINT_SW(entry.contents));
+                        print_error_type(string_match, msg, matcher, location, (int)(matcher->current - start));
+                        print_error_context("See definition for context.", {matcher->state, definition.name});
                     }
-                    break;
+                    return false;
                 }
-                case mt_expression: {
-                    auto end = string_match_get_end_of_expression(matcher->current);
-                    match->field_values.emplace_back(make_any(string_view{matcher->current, end}));
-                    advance(matcher, end);
-                    break;
+                if (words_detected > 1) {
+                    match->field_values.emplace_back(make_any(move(value)));
+                } else {
+                    match->field_values.emplace_back(make_any(string_view{first_word, first_word_end}));
                 }
-                case mt_custom: {
-                    assert(entry.match.custom);
-                    auto val = &match->field_values.emplace_back();
-                    if (!string_match_definition(*entry.match.custom, matcher, val, local_print_error)) {
-                        not_parsed = true;
+                if (word_ranges) word_ranges[current_range].max = words_detected + 1;
+                ++current_range;
+                if (words_matched) *words_matched = current_range;
+                break;
+            }
+            case mt_type: {
+                auto val = &match->field_values.emplace_back();
+                switch (entry.match.type.id) {
+                    case tid_bool: {
+                        if (!string_match_bool(matcher, val, print_error)) return false;
+                        break;
                     }
-                    break;
-                }
-                case mt_raw: {
-                    skip_whitespace(matcher);
-                    auto current = matcher->current;
-                    auto word_end = tmsu_find_first_of_v(tmsu_view_n(current, last), WHITESPACE);
-                    if (entry.contents != string_view{current, word_end}) {
-                        if (local_print_error) {
-                            auto msg = print_string("Tokens do not match pattern: \"%.*s\".", PRINT_SW(entry.contents));
-                            print_error_type(string_match, msg, matcher, matcher->location, (int)(word_end - current));
-                            print_error_context("See definition for context.", {matcher->state, definition.name});
-                        }
-                        not_parsed = true;
+                    case tid_int: {
+                        if (!string_match_int(matcher, val, print_error)) return false;
+                        break;
+                    }
+                    case tid_string: {
+                        if (!string_match_string(matcher, val, print_error)) return false;
+                        break;
+                    }
+                    default: {
+                        assert(0 && "Invalid type id.");
                         break;
                     }
-                    advance_column(matcher, word_end);
-                    break;
                 }
+                break;
+            }
+            case mt_expression: {
+                auto end = string_match_get_end_of_expression(matcher->current);
+                match->field_values.emplace_back(make_any(string_view{matcher->current, end}));
+                advance(matcher, end);
+                break;
+            }
+            case mt_custom: {
+                assert(entry.match.custom);
+                auto val = &match->field_values.emplace_back();
+                if (!string_match_definition(*entry.match.custom, matcher, val, print_error)) return false;
+                break;
             }
-            if (!not_parsed && entry.type != mt_word) {
-                // Reset word ranges, since following ranges might now detect more than before.
-                for (size_t i = entry_index + 1; i < entries_count; ++i) {
-                    auto& other = match_entries[i];
-                    if (other.type == mt_word) {
-                        word_ranges[current_range + i - 2] = other.word_range;
+            case mt_raw: {
+                skip_whitespace(matcher);
+                auto current = matcher->current;
+                auto word_end = tmsu_find_first_of_v(tmsu_view_n(current, last), WHITESPACE);
+                if (entry.contents != string_view{current, word_end}) {
+                    if (print_error) {
+                        auto msg = print_string("Tokens do not match pattern: \"%.*s\".", PRINT_SW(entry.contents));
+                        print_error_type(string_match, msg, matcher, matcher->location, (int)(word_end - current));
+                        print_error_context("See definition for context.", {matcher->state, definition.name});
                     }
+                    return false;
                 }
+                advance_column(matcher, word_end);
+                break;
             }
-            if (not_parsed) break;
         }
+    }
+    return true;
+}
+
+bool string_match_pattern(const match_type_definition_t& definition, string_matcher* matcher, any_t* out,
+                          bool print_error = true) {
+    assert(definition.type == td_pattern);
+    assert(definition.finalized);
+    assert(matcher);
+    assert(out);
+
+    auto match = &out->to_pattern();
+    match->definition = &definition;
+
+    auto pattern = &definition.pattern;
+
+    skip_whitespace(matcher);
 
-        if (local_print_error && !not_parsed) return false;
-        if (not_parsed) {
-            if (!word_ranges.size()) return false;
-            bool changed = false;
-            for (size_t i = word_ranges.size(); i > 0; --i) {
+    auto last = matcher->current_file.contents.end();
+
+    if (!pattern->ambiguous) {
+        // Every entry matches a fixed number of words, so there is only one way to match the string. Errors of
+        // entries are only reported without words, since words may have consumed what following entries expected.
+        bool print_entry_errors = print_error && pattern->word_ranges.empty();
+        if (!string_match_pattern_entries(definition, matcher, match, nullptr, nullptr, print_entry_errors)) {
+            return false;
+        }
+    } else {
+        // Start with every word matching as much as it can. On failure, the last word that matched and can give up a
+        // word matches one word less, while the words after it start over with their initial ranges, like an
+        // odometer. Every try decreases the matched ranges, so this terminates.
+        auto word_ranges = pattern->word_ranges;
+        size_t ranges_count = word_ranges.size();
+        auto backup = get_state(matcher);
+        size_t words_matched = 0;
+        while (!string_match_pattern_entries(definition, matcher, match, word_ranges.data(), &words_matched, false)) {
+            size_t narrowed = words_matched;
+            for (size_t i = words_matched; i > 0; --i) {
                 auto& range = word_ranges[i - 1];
-                if (range.max <= 0) continue;
+                assert(range.max >= 0);
                 if (range.max - range.min > 1) {
                     --range.max;
-                    changed = true;
+                    narrowed = i - 1;
                     break;
                 }
             }
-            if (!changed) return false;
+            if (narrowed == words_matched) return false;
+            for (size_t i = narrowed + 1; i < ranges_count; ++i) {
+                word_ranges[i] = pattern->word_ranges[i];
+            }
             set_state(matcher, backup);
         }
     }
@@ -310,17 +327,33 @@ bool string_match_sum(const match_type_definition_t& definition, string_matcher*
     assert(matcher);
     assert(out);
 
-    UNREFERENCED_PARAM(print_error);
-
     const auto& sum = definition.sum;
+    assert(sum.first_words.size() == sum.entries.size());
+
+    // Entries that start with a raw word are only tried if the string starts with it.
+    auto peek = *matcher;
+    skip_whitespace(&peek);
+    auto last = matcher->current_file.contents.end();
+    string_view first_word = {peek.current, tmsu_find_first_of_v(tmsu_view_n(peek.current, last), WHITESPACE)};
+
+    // The entry that consumes the most wins, the first one of those that consume the same.
+    any_t max_value;
+    tokenizer_state_t max_state = {};
     const match_type_definition_t* max_pattern = nullptr;
     size_t max_consumed = 0;
-    for (const auto& pattern : sum.entries) {
+    for (size_t i = 0, count = sum.entries.size(); i < count; ++i) {
+        auto& expected_word = sum.first_words[i];
+        if (!expected_word.empty() && expected_word != first_word) continue;
+
+        auto pattern = sum.entries[i];
         auto matcher_copy = *matcher;
         auto start = matcher_copy.current;
-        if (string_match_pattern(*pattern, &matcher_copy, out, /*print_error=*/false)) {
+        any_t value;
+        if (string_match_pattern(*pattern, &matcher_copy, &value, /*print_error=*/false)) {
             size_t consumed = (size_t)(matcher_copy.current - start);
             if (consumed > max_consumed) {
+                max_value = move(value);
+                max_state = get_state(&matcher_copy);
                 max_pattern = pattern;
                 max_consumed = consumed;
             }
@@ -334,9 +367,9 @@ bool string_match_sum(const match_type_definition_t& definition, string_matcher*
         }
         return false;
     }
-    auto result = string_match_pattern(*max_pattern, matcher, out, print_error);
-    assert(result);
-    return result;
+    *out = move(max_value);
+    set_state(matcher, max_state);
+    return true;
 }
 
 bool string_match_sum(const symbol_entry_t* symbol, string_matcher* matcher, any_t* out) {
@@ -365,7 +398,7 @@ bool string_match_definition(const match_type_definition_t& definition, string_m
     return false;
 }
 
-bool string_match_definition(process_state_t* state, const match_type_definition_t& definition, const string& str,
+bool string_match_definition(process_state_t* state, const match_type_definition_t& definition, string_view str,
                              stream_loc_ex_t origin_location, any_t* out, bool print_error = true) {
     string_matcher matcher;
     static_cast<tokenizer_t&>(matcher) = make_tokenizer(str, {});
@@ -2,15 +2,22 @@ struct parsing_state_t;
 bool parse_source_file(parsing_state_t* parsed, int file_index);
 
 struct parsed_state_t {
+    // Allocator that everything parsed is allocated from and the table its identifiers are interned in, bound together
+    // while parsing and processing (see parsed_state_scope_t).
+    monotonic_block_allocator* allocator = current_allocator;
+    identifier_table_t* identifiers = current_identifiers;
+
     vector_of_monotonic<match_type_definition_t> match_type_definitions;
     vector_of_monotonic<generator_t> generators;
     vector<symbol_table_t> symbol_tables = vector<symbol_table_t>(1);
     vector<file_data> source_files;
     bool verbose = false;
+    std::string cache_directory;  // Files parsed by parse_files are cached here if not empty, see parse_cache.cpp.
     bool valid = false;
 
     formatted_segment_t toplevel_segment;
     int toplevel_stack_size = 0;
+    vm_program_t toplevel_program;  // Lowered toplevel_segment, only used when running with engine_vm.
 
     parsed_state_t() {
         // Add builtin global symbols.
@@ -51,58 +58,66 @@ struct parsed_state_t {
 
     symbol_entry_t* add_symbol(string_token name, typeid_info type, int symbol_table_index, string_token type_name) {
         auto table = &symbol_tables[symbol_table_index];
-        symbol_entry_t data = {name, type_name, type};
-        return table->symbols.emplace_back(make_monotonic_unique<symbol_entry_t>(data)).get();
+        symbol_entry_t data = {name};
+        data.name_id = (name.identifier_id >= 0) ? name.identifier_id : intern_identifier(name.contents);
+        data.match_type_definition_name = type_name;
+        data.type = type;
+        return table->add(data);
     }
     int add_symbol_table(int parent) {
         symbol_tables.emplace_back(parent);
         return (int)(symbol_tables.size() - 1);
     }
 
+    symbol_entry_t* find_symbol_flat(int name_id, int table_index) { return symbol_tables[table_index].find(name_id); }
+    const symbol_entry_t* find_symbol_flat(int name_id, int table_index) const {
+        return symbol_tables[table_index].find(name_id);
+    }
     symbol_entry_t* find_symbol_flat(string_view name, int table_index) {
-        auto table = &symbol_tables[table_index];
-        auto it = find_if(table->symbols.begin(), table->symbols.end(),
-                          [name](const auto& entry) { return entry->name.contents == name; });
-        if (it != table->symbols.end()) return it->get();
-        return nullptr;
+        return find_symbol_flat(find_identifier(name), table_index);
     }
     const symbol_entry_t* find_symbol_flat(string_view name, int table_index) const {
-        auto table = &symbol_tables[table_index];
-        auto it = find_if(table->symbols.begin(), table->symbols.end(),
-                          [name](const auto& entry) { return entry->name.contents == name; });
-        if (it != table->symbols.end()) return it->get();
-        return nullptr;
+        return find_symbol_flat(find_identifier(name), table_index);
     }
 
-    symbol_entry_t* find_symbol(string_view name, int current_symbol_table) {
+    symbol_entry_t* find_symbol(int name_id, int current_symbol_table) {
+        if (name_id < 0) return nullptr;
         for (auto i = current_symbol_table; i >= 0;) {
             bool was_top_level = (i == 0);
-            auto symbol = find_symbol_flat(name, i);
+            auto symbol = find_symbol_flat(name_id, i);
             if (symbol) return symbol;
             if (was_top_level) return nullptr;
             i = symbol_tables[i].parent_symbol_table_index;
         }
         return nullptr;
     }
-
+    const symbol_entry_t* find_symbol(int name_id, int current_symbol_table) const {
+        return const_cast<parsed_state_t*>(this)->find_symbol(name_id, current_symbol_table);
+    }
+    symbol_entry_t* find_symbol(string_view name, int current_symbol_table) {
+        return find_symbol(find_identifier(name), current_symbol_table);
+    }
     const symbol_entry_t* find_symbol(string_view name, int current_symbol_table) const {
-        for (auto i = current_symbol_table; i >= 0;) {
-            bool was_top_level = (i == 0);
-            auto symbol = find_symbol_flat(name, i);
-            if (symbol) return symbol;
-            if (was_top_level) return nullptr;
-            i = symbol_tables[i].parent_symbol_table_index;
-        }
-        return nullptr;
+        return find_symbol(find_identifier(name), current_symbol_table);
     }
 };
 
+// Binds the allocator and identifier table of parsed to the calling thread while in scope.
+struct parsed_state_scope_t {
+    monotonic_allocator_scope_t allocator_scope;
+    identifier_table_scope_t identifiers_scope;
+
+    explicit parsed_state_scope_t(parsed_state_t* parsed)
+        : allocator_scope(parsed->allocator), identifiers_scope(parsed->identifiers) {}
+};
+
 struct parsing_state_t {
     parsed_state_t* data = nullptr;
     int current_symbol_table = 0;
     int nested_for_statements = 0;
     int current_stack_size = 0;
     bool verbose = false;
+    bool is_fragment = false;  // Parsing a single file on its own, see parse_files.
 
     parsing_state_t(parsed_state_t* data) : data(data) {
         assert(data);
@@ -140,6 +155,10 @@ struct parsing_state_t {
         assert(data);
         return data->find_symbol(name, current_symbol_table);
     }
+    symbol_entry_t* find_symbol(int name_id) {
+        assert(data);
+        return data->find_symbol(name_id, current_symbol_table);
+    }
 
     explicit operator bool() const { return data && data->valid; };
 
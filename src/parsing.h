@@ -104,7 +104,7 @@ parse_result parse_type_definition_field(tokenizer_t* tokenizer, match_type_defi
                             }
                         }
                     } else {
-                        entry.word_range.max = entry.word_range.min * 2;
+                        entry.word_range.max = entry.word_range.min + 1;
                     }
                     if (!require_token_type(tokenizer, next_token(tokenizer), tok_curly_close, "Expected '}'.")) {
                         return pr_error;
@@ -141,14 +141,11 @@ parse_result parse_type_definition_field(tokenizer_t* tokenizer, match_type_defi
 bool is_unique_symbol(const parsing_state_t* parsing, const token_t& name) {
     // Only look in the current scope for name conflicts.
     auto& current_table = parsing->data->symbol_tables[parsing->current_symbol_table];
-    for (auto& unique_symbol : current_table.symbols) {
-        auto symbol = unique_symbol.get();
-        if (symbol->name.contents == name.contents) {
-            auto msg = print_string("Identifier \"%.*s\" already taken.", PRINT_SW(name.contents));
-            print_error_context(msg, {parsing, name});
-            print_error_context("See previous declaration.", {parsing, symbol->name});
-            return false;
-        }
+    if (auto symbol = current_table.find(name.identifier_id)) {
+        auto msg = print_string("Identifier \"%.*s\" already taken.", PRINT_SW(name.contents));
+        print_error_context(msg, {parsing, name});
+        print_error_context("See previous declaration.", {parsing, symbol->name});
+        return false;
     }
     return true;
 }
@@ -472,6 +469,7 @@ parse_result parse_for_statement(tokenizer_t* tokenizer, parsing_state_t* parsin
     if (parse_block_statement(tokenizer, parsing, &for_statement->body, skip) != pr_success) return pr_error;
 
     for_statement->variable = variable.contents;
+    for_statement->variable_id = variable.identifier_id;
 
     // Type of variable depends on expression
     typeid_info type = get_dereferenced_type(for_statement->container_expression->result_type);
@@ -485,6 +483,37 @@ parse_result parse_for_statement(tokenizer_t* tokenizer, parsing_state_t* parsin
     return pr_success;
 }
 
+parse_result parse_output_statement(tokenizer_t* tokenizer, parsing_state_t* parsing, statement_t* statement,
+                                    whitespace_skip skip, bool* can_semicolon_follow) {
+    // Only a statement if followed by '(', otherwise "output" is an ordinary identifier.
+    auto state = get_state(tokenizer);
+    if (!consume_token_if_identifier(tokenizer, "output") || peek_token(tokenizer).type != tok_paren_open) {
+        set_state(tokenizer, state);
+        return pr_no_match;
+    }
+    if (can_semicolon_follow) *can_semicolon_follow = false;
+
+    statement->set_type(stmt_output);
+    auto output_statement = &statement->output_statement;
+
+    ++skip.indentation;
+
+    if (!require_token_type(tokenizer, next_token(tokenizer), tok_paren_open, "'(' expected.")) return pr_error;
+    if (parse_expression(tokenizer, &output_statement->path_expression) != pr_success) return pr_error;
+    if (!require_token_type(tokenizer, next_token(tokenizer), tok_paren_close, "')' expected.")) return pr_error;
+
+    // The body is written to a different output, so it can't refer to enclosing for statements with break, continue
+    // or comma statements.
+    auto prev_nested_for_statements = parsing->nested_for_statements;
+    parsing->nested_for_statements = 0;
+    output_statement->scope_index = parsing->push_scope();
+    if (parse_block_statement(tokenizer, parsing, &output_statement->body, skip) != pr_success) return pr_error;
+    parsing->pop_scope();
+    parsing->nested_for_statements = prev_nested_for_statements;
+
+    return pr_success;
+}
+
 parse_result parse_generator(tokenizer_t* tokenizer, parsing_state_t* parsing, whitespace_skip skip);
 
 parse_result parse_single_statement_impl(tokenizer_t* tokenizer, parsing_state_t* parsing, formatted_segment_t* segment,
@@ -516,6 +545,11 @@ parse_result parse_single_statement_impl(tokenizer_t* tokenizer, parsing_state_t
                 }
                 break;
             }
+            case 'o': {
+                auto output_result = parse_output_statement(tokenizer, parsing, statement, skip, can_semicolon_follow);
+                if (output_result != pr_no_match) return output_result;
+                break;
+            }
             case 'b':
             case 'c': {
                 bool is_break = token.contents == "break";
@@ -623,6 +657,8 @@ parse_result parse_single_statement(tokenizer_t* tokenizer, parsing_state_t* par
 
 parse_result parse_include_statement(tokenizer_t* tokenizer, parsing_state_t* parsing) {
     if (!consume_token_if_identifier(tokenizer, "include")) return pr_no_match;
+    // Includes have to be parsed in place, parse_files parses this file again without a fragment.
+    if (parsing->is_fragment) return pr_error;
 
     auto path = next_token(tokenizer);
     if (!require_token_type(tokenizer, path, tok_string, "Expected path string.")) return pr_error;
@@ -941,6 +977,12 @@ parse_result parse_generator(tokenizer_t* tokenizer, parsing_state_t* parsing, w
         return pr_error;
     }
 
+    // A call of a generator named output would be parsed as an $output statement, see parse_output_statement.
+    if (name.contents == "output") {
+        print_error_context("\"output\" is reserved for the $output statement and can't name a generator.", tokenizer,
+                            name);
+        return pr_error;
+    }
     if (!is_unique_symbol(parsing, name)) return pr_error;
 
     if (!require_token_type(tokenizer, next_token(tokenizer), tok_paren_open, "Expected '(' after generator name.")) {
@@ -1,4 +1,6 @@
 bool infer_expression_types_expression(process_state_t* state, expression_t* expression);
+bool infer_expression_types_expression(process_state_t* state, unique_expression_t* expression);
+void mark_written(expression_t* exp);
 
 bool is_expression_convertible_to(process_state_t* state, expression_t* exp, typeid_info to,
                                   const match_type_definition_t* definition, any_t* compile_time_value) {
@@ -15,10 +17,11 @@ bool is_expression_convertible_to(process_state_t* state, expression_t* exp, typ
     } else if (exp->value_category == exp_value_constant) {
         if (to.id == tid_bool) {
             // Only the int literals 1 and 0 are convertible to bool.
-            if (exp->type == exp_constant && exp->result_type.is(tid_int, 0)) {
-                auto constant = static_cast<expression_constant_t*>(exp);
-                success = constant->contents == "0" || constant->contents == "1";
-                if (success) *compile_time_value = make_any(constant->contents == "1");
+            if (exp->type == exp_compile_time_evaluated && exp->result_type.is(tid_int, 0) &&
+                static_cast<expression_compile_time_evaluated_t*>(exp)->is_literal) {
+                auto value = static_cast<expression_compile_time_evaluated_t*>(exp)->value.as_int();
+                success = value == 0 || value == 1;
+                if (success) *compile_time_value = make_any(value == 1);
             } else {
                 success = false;
             }
@@ -70,10 +73,10 @@ bool is_expression_convertible_to(process_state_t* state, expression_t* exp, typ
 }
 
 bool infer_expression_types_concrete_expression(process_state_t* state, expression_two_t* exp) {
+    if (!infer_expression_types_expression(state, &exp->lhs)) return false;
+    if (!infer_expression_types_expression(state, &exp->rhs)) return false;
     auto lhs = exp->lhs.get();
     auto rhs = exp->rhs.get();
-    if (!infer_expression_types_expression(state, lhs)) return false;
-    if (!infer_expression_types_expression(state, rhs)) return false;
 
     switch (exp->type) {
         case exp_subscript: {
@@ -118,6 +121,7 @@ bool infer_expression_types_concrete_expression(process_state_t* state, expressi
                 print_error_context("Expression must have reference value category.", {state, lhs->location});
                 return false;
             }
+            mark_written(lhs);
             any_t compile_time_value;
             if (!is_expression_convertible_to(state, rhs, lhs->result_type, lhs->definition, &compile_time_value)) {
                 return false;
@@ -164,8 +168,8 @@ bool infer_expression_types_concrete_expression(process_state_t* state, expressi
     return true;
 }
 bool infer_expression_types_concrete_expression(process_state_t* state, expression_one_t* exp) {
+    if (!infer_expression_types_expression(state, &exp->child)) return false;
     auto child = exp->child.get();
-    if (!infer_expression_types_expression(state, child)) return false;
     switch (exp->type) {
         case exp_unary_plus:
         case exp_unary_minus: {
@@ -203,7 +207,7 @@ bool infer_expression_types_concrete_expression(process_state_t* state, expressi
         exp->builtin_function = function;
         return true;
     }
-    auto symbol = state->find_symbol(exp->identifier);
+    auto symbol = state->find_symbol(exp->identifier_id);
     if (!symbol) {
         auto msg = print_string("Unknown identifier \"%.*s\".", PRINT_SW(exp->identifier));
         print_error_context(msg, {state, exp->location});
@@ -234,7 +238,7 @@ bool infer_expression_types_concrete_generator(process_state_t* state, expressio
     assert(identifier->symbol);
     assert(identifier->symbol->type == identifier->result_type);
 
-    auto generator_symbol = state->find_symbol(identifier->symbol->name.contents);
+    auto generator_symbol = state->find_symbol(identifier->symbol->name_id);
     if (!generator_symbol || !generator_symbol->generator) {
         print_error_context("Internal error: Symbol exists but generator doesn't.", {state, exp->location});
         return false;
@@ -252,8 +256,8 @@ bool infer_expression_types_concrete_generator(process_state_t* state, expressio
     vector<int> supplied_params;
     for (int i = 0; i < arguments_count; ++i) {
         auto* unique_arg = &args->at(i);
+        if (!infer_expression_types_expression(state, unique_arg)) return false;
         auto* arg = unique_arg->get();
-        if (!infer_expression_types_expression(state, arg)) return false;
         assert(arg->result_type.id != tid_undefined || arg->result_type.array_level > 0);
 
         const symbol_entry_t* symbol = nullptr;
@@ -278,7 +282,7 @@ bool infer_expression_types_concrete_generator(process_state_t* state, expressio
                     const auto* param = &generator->parameters[param_index];
                     // Make absolutely sure that parameter points to the same symbol as the symbol that the identifier
                     // was inferred to.
-                    symbol = state->find_symbol_flat(param->variable.contents, generator->scope_index);
+                    symbol = state->find_symbol_flat(param->variable.identifier_id, generator->scope_index);
                     if (symbol == arg_identifier->symbol) {
                         // We found a named param
                         is_named_param = true;
@@ -307,7 +311,7 @@ bool infer_expression_types_concrete_generator(process_state_t* state, expressio
                 return false;
             }
             const auto* param = &generator->parameters[i];
-            symbol = state->find_symbol_flat(param->variable.contents, generator->scope_index);
+            symbol = state->find_symbol_flat(param->variable.identifier_id, generator->scope_index);
             if (i < required_params_count) ++supplied_required_params_count;
             supplied_params.push_back(i);
         }
@@ -376,7 +380,7 @@ bool infer_expression_types_builtin_function(process_state_t* state, expression_
         return false;
     }
 
-    exp_value_category_enum value_category = exp_value_constant;
+    exp_value_category_enum value_category = func->reads_external_data ? exp_value_runtime : exp_value_constant;
     for (size_t i = 0, count = args->size(); i < count; ++i) {
         auto arg = args->at(i).get();
         if (arg->value_category != exp_value_constant) {
@@ -391,12 +395,12 @@ bool infer_expression_types_builtin_function(process_state_t* state, expression_
 }
 
 bool infer_expression_types_concrete_expression(process_state_t* state, expression_call_t* exp) {
+    if (!infer_expression_types_expression(state, &exp->lhs)) return false;
     auto lhs = exp->lhs.get();
-    if (!infer_expression_types_expression(state, lhs)) return false;
     // infer_expression_types_concrete_generator will do inferring of the arguments itself.
     if (!lhs->result_type.is(tid_generator, 0)) {
         for (auto&& arg : exp->arguments) {
-            if (!infer_expression_types_expression(state, arg.get())) return false;
+            if (!infer_expression_types_expression(state, &arg)) return false;
         }
     }
 
@@ -420,6 +424,7 @@ bool infer_expression_types_concrete_expression(process_state_t* state, expressi
 
         auto inferred_method = dot->inferred.back();
         exp->method = inferred_method.method;
+        if (exp->method->modifies_object) mark_written(dot->lhs.get());
 
         dot->fields.pop_back();
         dot->inferred.pop_back();
@@ -492,8 +497,8 @@ bool infer_expression_types_concrete_expression(process_state_t* state, expressi
         typeid_info entry_type = {tid_undefined, 0};
         exp_value_category_enum category = exp_value_constant;
         for (auto& unique_entry : entries) {
+            if (!infer_expression_types_expression(state, &unique_entry)) return false;
             auto entry = unique_entry.get();
-            if (!infer_expression_types_expression(state, entry)) return false;
             if (entry->result_type.array_level < entry_type.array_level) {
                 auto msg = print_string("Expected array with dimension %d.", entry_type.array_level);
                 auto location = entry->location;
@@ -576,7 +581,7 @@ bool get_common_field_type_from_sum(process_state_t* state, const type_sum* sum,
 }
 
 bool infer_expression_types_concrete_expression(process_state_t* state, expression_dot_t* exp) {
-    if (!infer_expression_types_expression(state, exp->lhs.get())) return false;
+    if (!infer_expression_types_expression(state, &exp->lhs)) return false;
 
     // Error printing helper.
     auto print_field_error = [](const process_state_t* state, typeid_info type, string_token field) {
@@ -684,6 +689,117 @@ bool infer_expression_types_expression(process_state_t* state, expression_t* exp
                             [state](auto* exp) { return infer_expression_types_concrete_expression(state, exp); });
 }
 
+// Strings and arrays share their contents between copies (see any.h). Writes are tracked while inferring, so that
+// arrays are only pinned at runtime where references into their entries are written through.
+void mark_written(expression_t* exp) {
+    switch (exp->type) {
+        case exp_identifier: {
+            auto identifier = static_cast<expression_identifier_t*>(exp);
+            if (exp->result_type.id == tid_function || !identifier->symbol) return;
+            auto symbol = identifier->symbol;
+            if (symbol->written) return;
+            symbol->written = true;
+            if (symbol->aliased_expression) mark_written(symbol->aliased_expression);
+            break;
+        }
+        case exp_subscript: {
+            auto subscript = static_cast<expression_subscript_t*>(exp);
+            subscript->mutable_access = true;
+            mark_written(subscript->lhs.get());
+            break;
+        }
+        case exp_dot: {
+            mark_written(static_cast<expression_dot_t*>(exp)->lhs.get());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+const any_t* get_compile_time_value(const expression_t* exp) {
+    if (exp->type != exp_compile_time_evaluated) return nullptr;
+    return &static_cast<const expression_compile_time_evaluated_t*>(exp)->value;
+}
+
+void replace_by_compile_time_value(unique_expression_t* expression, any_t value) {
+    auto exp = expression->get();
+    auto compile_time_exp = make_expression<exp_compile_time_evaluated>(exp->location);
+    compile_time_exp->result_type = exp->result_type;
+    compile_time_exp->value = move(value);
+    compile_time_exp->value_category = exp_value_constant;
+    compile_time_exp->is_literal = exp->type == exp_constant;
+    *expression = move(compile_time_exp);
+}
+
+// Replaces constant expressions by their value, so that they are evaluated once during processing instead of every
+// time they are evaluated. Children are already folded, since they are inferred first.
+void fold_constant_expression(process_state_t* state, unique_expression_t* expression) {
+    auto exp = expression->get();
+    if (exp->type == exp_compile_time_evaluated) return;
+
+    if (exp->type == exp_and || exp->type == exp_or) {
+        // Short circuit if the lhs alone decides the result, even if the rhs is only known at runtime.
+        auto two = static_cast<expression_two_t*>(exp);
+        auto lhs_value = get_compile_time_value(two->lhs.get());
+        if (lhs_value && lhs_value->is(tid_bool, 0) && lhs_value->as_bool() == (exp->type == exp_or)) {
+            replace_by_compile_time_value(expression, make_any(lhs_value->as_bool()));
+            return;
+        }
+    }
+
+    if (exp->value_category != exp_value_constant) return;
+    // Matches keep their definition and custom types are not copyable, both are left for runtime.
+    auto id = exp->result_type.id;
+    if (id != tid_int && id != tid_bool && id != tid_string && id != tid_int_range) return;
+    if (exp->type == exp_div || exp->type == exp_mod) {
+        // Division by zero is left for runtime, in case the expression is never evaluated.
+        auto rhs_value = get_compile_time_value(static_cast<expression_two_t*>(exp)->rhs.get());
+        int divisor = 0;
+        if (!rhs_value || !rhs_value->try_convert_to_int(&divisor) || divisor == 0) return;
+    }
+
+    any_t value;
+    try {
+        value = evaluate_expression_throws(state, exp);
+    } catch (tg_exeption) {
+        // Errors are reported once the expression is evaluated at runtime.
+        return;
+    }
+    if (!value || value.type.is(tid_reference, 0)) return;
+    replace_by_compile_time_value(expression, move(value));
+}
+
+// Infers the types of an expression that is owned by expression, which allows the expression to be replaced.
+bool infer_expression_types_expression(process_state_t* state, unique_expression_t* expression) {
+    if (!infer_expression_types_expression(state, expression->get())) return false;
+    fold_constant_expression(state, expression);
+    return true;
+}
+
+// Only the taken branch of an if statement with a constant condition is kept, as the then branch with a true
+// condition. If no branch is taken, the statement is replaced by an empty literal.
+void eliminate_dead_branch(statement_t* statement) {
+    assert(statement->type == stmt_if);
+    auto if_stmt = &statement->if_statement;
+    auto condition = get_compile_time_value(if_stmt->condition.get());
+    bool condition_value = false;
+    if (!condition || !condition->try_convert_to_bool(&condition_value)) return;
+
+    if (!condition_value) {
+        if (!if_stmt->else_block.valid) {
+            statement->set_type(stmt_literal);
+            return;
+        }
+        if_stmt->then_block = move(if_stmt->else_block);
+        if_stmt->then_scope_index = if_stmt->else_scope_index;
+        static_cast<expression_compile_time_evaluated_t*>(if_stmt->condition.get())->value = make_any(true);
+    }
+    if_stmt->else_block = {};
+    if_stmt->else_scope_index = -1;
+}
+
 void check_instanceof_condition(process_state_t* state, expression_t* condition, int then_scope_index,
                                 int else_scope_index) {
     expression_t* exp = condition;
@@ -713,8 +829,7 @@ void check_instanceof_condition(process_state_t* state, expression_t* condition,
                 auto new_symbol = *lhs_symbol;
                 new_symbol.definition = rhs_symbol->definition;
                 new_symbol.type = typeid_from_definition(*rhs_symbol->definition);
-                state->data->symbol_tables[then_scope_index].symbols.emplace_back(
-                    make_monotonic_unique<symbol_entry_t>(new_symbol));
+                state->data->symbol_tables[then_scope_index].add(new_symbol);
                 return;
             }
             case exp_not: {
@@ -757,12 +872,13 @@ void check_instanceof_condition(process_state_t* state, expression_t* condition,
 }
 
 bool infer_declaration_types(process_state_t* state, stmt_declaration_t* declaration) {
-    auto symbol = state->find_symbol(declaration->variable.contents);
+    auto symbol = state->find_symbol(declaration->variable.identifier_id);
     assert(symbol);
 
     if (declaration->expression) {
+        if (!infer_expression_types_expression(state, &declaration->expression)) return false;
         auto exp = declaration->expression.get();
-        if (!infer_expression_types_expression(state, exp)) return false;
+        if (exp->value_category == exp_value_reference) symbol->aliased_expression = exp;
         if (declaration->infer_type) {
             assert(declaration->expression);
             symbol->type = exp->result_type;
@@ -816,7 +932,7 @@ bool infer_expression_types_segment(process_state_t* state, formatted_segment_t*
             case stmt_if: {
                 auto if_stmt = &statement.if_statement;
 
-                if (!infer_expression_types_expression(state, if_stmt->condition.get())) return false;
+                if (!infer_expression_types_expression(state, &if_stmt->condition)) return false;
                 check_instanceof_condition(state, if_stmt->condition.get(), if_stmt->then_scope_index,
                                            if_stmt->else_scope_index);
 
@@ -828,26 +944,29 @@ bool infer_expression_types_segment(process_state_t* state, formatted_segment_t*
                     if (!infer_expression_types_block(state, &if_stmt->else_block)) return false;
                 }
                 state->set_scope(prev_scope);
+                eliminate_dead_branch(&statement);
                 continue;
             }
             case stmt_for: {
                 auto for_stmt = &statement.for_statement;
                 auto prev_scope = state->set_scope(for_stmt->scope_index);
 
+                if (!infer_expression_types_expression(state, &for_stmt->container_expression)) return false;
                 auto container = for_stmt->container_expression.get();
-                if (!infer_expression_types_expression(state, container)) return false;
                 // Int ranges are iteratable by default.
+                auto element_type = get_dereferenced_type(container->result_type);
                 if (!container->result_type.is(tid_int_range, 0)) {
                     auto container_type = state->builtin.get_builtin_type(container->result_type);
                     if (!container_type || !container_type->is_iteratable) {
                         print_error_context("Expression is not iterateble.", {state, container->location});
                         return false;
                     }
+                    if (container_type->element_type.id != tid_undefined) element_type = container_type->element_type;
                 }
-                auto symbol = state->find_symbol_flat(for_stmt->variable, for_stmt->scope_index);
+                auto symbol = state->find_symbol_flat(for_stmt->variable_id, for_stmt->scope_index);
                 assert(symbol);
                 if (symbol->type.id == tid_undefined) {
-                    symbol->type = get_dereferenced_type(container->result_type);
+                    symbol->type = element_type;
                     if (symbol->type.id == tid_undefined) {
                         print_error_context("Expression is not an iterateble.", {state, container->location});
                         return false;
@@ -856,11 +975,31 @@ bool infer_expression_types_segment(process_state_t* state, formatted_segment_t*
                 }
                 symbol->declaration_inferred = true;
                 if (!infer_expression_types_block(state, &for_stmt->body)) return false;
+                if (symbol->written) {
+                    // The loop variable references entries of the container.
+                    for_stmt->mutable_elements = true;
+                    mark_written(container);
+                }
+                state->set_scope(prev_scope);
+                continue;
+            }
+            case stmt_output: {
+                auto output_stmt = &statement.output_statement;
+
+                if (!infer_expression_types_expression(state, &output_stmt->path_expression)) return false;
+                auto path = output_stmt->path_expression.get();
+                if (!path->result_type.is(tid_string, 0)) {
+                    print_error_context("Output path must be a string.", {state, path->location});
+                    return false;
+                }
+
+                auto prev_scope = state->set_scope(output_stmt->scope_index);
+                if (!infer_expression_types_block(state, &output_stmt->body)) return false;
                 state->set_scope(prev_scope);
                 continue;
             }
             case stmt_expression: {
-                if (!infer_expression_types_expression(state, statement.formatted.expression.get())) return false;
+                if (!infer_expression_types_expression(state, &statement.formatted.expression)) return false;
                 continue;
             }
             case stmt_declaration: {
@@ -38,6 +38,7 @@ bool finalize_match_type_definitions(parsed_state_t* state) {
         } else {
             assert(0);
         }
+        compile_match_type_definition(definition);
         definition->finalized = true;
     }
     return true;
@@ -116,6 +117,9 @@ bool determine_segment_output(formatted_segment_t* segment, int skip_next_newlin
             if (then_has_output || else_has_output) has_output = true;
         } else if (statement.type == stmt_for) {
             if (determine_block_output(&statement.for_statement.body)) has_output = true;
+        } else if (statement.type == stmt_output) {
+            // Output statements write to a different output, so they don't contribute to this one.
+            determine_block_output(&statement.output_statement.body);
         } else if (statement.type != stmt_declaration) {
             if (statement.type == stmt_break || statement.type == stmt_continue) continue;
             if (statement.type == stmt_expression) {
@@ -166,6 +170,7 @@ void finalize_block_output(parsed_state_t* state) {
 
 bool process_parsed_data(process_state_t* state) {
     UNREFERENCED_PARAM(state);
+    parsed_state_scope_t parsed_scope{state->data};
     state->set_scope(0);
     if (!finalize_match_type_definitions(state->data)) return false;
     if (!finalize_symbol_tables(state->data)) return false;
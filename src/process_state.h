@@ -13,8 +13,37 @@ struct output_whitespace_context {
     int spaces = 0;
 };
 
+// Destination of generated output. Output gets appended to buffer, which is flushed to file once it grows past
+// flush_threshold, so that output doesn't have to be held in memory for the whole run.
+// Without a file the whole output stays in buffer, for callers that need it as a string.
+struct output_sink_t {
+    std::string buffer;
+    FILE* file = nullptr;
+    size_t flush_threshold = 64 * 1024;
+    int write_error = 0;  // Value of errno if writing to file failed.
+    size_t flushed_size = 0;
+
+    // Total bytes written to the sink so far.
+    size_t size() const { return flushed_size + buffer.size(); }
+
+    void flush_if_full() {
+        if (file && buffer.size() >= flush_threshold) flush();
+    }
+    bool flush() {
+        if (file && !buffer.empty()) {
+            errno = 0;
+            if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size() && !write_error) {
+                write_error = (errno != 0) ? errno : EIO;
+            }
+            flushed_size += buffer.size();
+            buffer.clear();
+        }
+        return write_error == 0;
+    }
+};
+
 struct output_context {
-    std::string stream;
+    output_sink_t sink;
     vector<nested_for_statement_entry> nested_for_statements;
 
     output_whitespace_context whitespace;
@@ -38,10 +67,24 @@ struct output_context {
     }
 };
 
+// Named output file that $output statements write to. Output is kept in memory until the run ends.
+struct output_target_t {
+    string path;
+    string canonical;  // See canonical_path, so that different spellings of path write to the same target.
+    output_context output;
+};
+
 struct value_storage {
     vector<any_t> values;
 };
 
+enum execution_engine_enum {
+    engine_ast,  // Evaluate statements and expressions by walking their trees.
+    engine_vm,   // Run bytecode created by lower_bytecode.cpp.
+};
+
+struct profiler_t;
+
 struct process_state_t {
     parsed_state_t* data;
     int current_symbol_table = 0;
@@ -52,7 +95,11 @@ struct process_state_t {
     // Execution/output contexts.
     vector<value_storage> value_stack;
     output_context output;
+    vector<unique_ptr<output_target_t>> output_targets;
+    vector<int> output_target_stack;  // Indices into output_targets of entered $output statements.
+    execution_engine_enum engine = engine_ast;
     bool verbose = false;
+    profiler_t* profiler = nullptr;  // Only set when running with --profile.
 
     process_state_t() = default;
     process_state_t(const process_state_t&) = delete;
@@ -73,6 +120,59 @@ struct process_state_t {
     symbol_entry_t* find_symbol_flat(string_view name, int scope_index) {
         return data->find_symbol_flat(name, scope_index);
     }
+    symbol_entry_t* find_symbol(int name_id) { return data->find_symbol(name_id, current_symbol_table); }
+    symbol_entry_t* find_symbol_flat(int name_id, int scope_index) { return data->find_symbol_flat(name_id, scope_index); }
+
+    // Total bytes written to all outputs so far.
+    size_t output_size() const {
+        size_t result = output.sink.size();
+        for (auto& target : output_targets) {
+            result += target->output.sink.size();
+        }
+        return result;
+    }
+
+    // Output that statements currently write to.
+    output_context* current_output() {
+        if (output_target_stack.empty()) return &output;
+        return &output_targets[output_target_stack.back()]->output;
+    }
+    void enter_output_target(string_view path) {
+        auto it = find_if(output_targets.begin(), output_targets.end(),
+                          [path](const auto& target) { return string_view{target->path} == path; });
+        if (it == output_targets.end()) {
+            // Paths like "a.h" and "./a.h" name the same file, which would otherwise be written twice concurrently.
+            auto canonical = canonical_path(string{path.data(), path.size()}.c_str());
+            it = find_if(output_targets.begin(), output_targets.end(),
+                         [&canonical](const auto& target) { return target->canonical == canonical; });
+            if (it == output_targets.end()) {
+                auto& added = output_targets.emplace_back(std::make_unique<output_target_t>());
+                added->path.assign(path.data(), path.size());
+                added->canonical = move(canonical);
+                it = output_targets.end() - 1;
+            }
+        }
+        output_target_stack.push_back((int)(it - output_targets.begin()));
+    }
+    void leave_output_target() {
+        assert(!output_target_stack.empty());
+        // Terminate the last line like evaluate_call does.
+        auto out = current_output();
+        if (out->whitespace.preceding_newlines) {
+            out->sink.buffer += '\n';
+            out->whitespace.preceding_newlines = 0;
+        }
+        output_target_stack.pop_back();
+    }
+
+    // Clears everything a previous invocation left behind, so that the processed data can be invoked again.
+    void reset_invocation() {
+        value_stack.clear();
+        output = {};
+        output_targets.clear();
+        output_target_stack.clear();
+        current_symbol_table = 0;
+    }
 
     void drop_invocation_symbol_tables(int scope_index) {
         assert(data);
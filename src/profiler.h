@@ -0,0 +1,247 @@
+/*
+Profiler enabled by --profile. While invoking, generators record their calls, wall time and output size, for statements
+their iterations and builtins their calls and wall time. profile_print_report prints the totals sorted by time.
+profile_write_collapsed_stacks writes the time spent in generator call chains in the collapsed stack format, that
+flamegraph tools take as input.
+*/
+
+using profile_clock = std::chrono::steady_clock;
+
+int64_t profile_elapsed_ns(profile_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(profile_clock::now() - start).count();
+}
+
+struct profile_entry_t {
+    int64_t count = 0;     // Calls, or iterations of for statements.
+    int64_t total_ns = 0;  // Wall time including nested generator calls.
+    int64_t self_ns = 0;   // Wall time excluding nested generator calls, only for generators.
+    int64_t bytes = 0;     // Output size, only for generators.
+    int active = 0;        // Recursive calls that are still running, only the outermost one adds to total_ns and bytes.
+};
+
+// Node of the generator call tree, node 0 is the toplevel.
+struct profile_call_node_t {
+    const generator_t* generator = nullptr;
+    int parent = -1;
+    vector<int> children;
+    int64_t self_ns = 0;
+};
+
+struct profile_frame_t {
+    int node;
+    profile_clock::time_point start;
+    int64_t nested_ns = 0;  // Time spent in generators called by this frame.
+    size_t output_size = 0;
+};
+
+struct profiler_t {
+    std::unordered_map<const generator_t*, profile_entry_t> generators;
+    std::unordered_map<const for_t*, profile_entry_t> for_statements;
+    std::unordered_map<const builtin_function_t*, profile_entry_t> builtins;
+
+    vector<profile_call_node_t> call_nodes = {{}};
+    vector<profile_frame_t> frames;
+    int64_t toplevel_ns = 0;
+
+    // Generator is null for the toplevel statements.
+    void enter(const generator_t* generator, size_t output_size) {
+        int node = 0;
+        if (generator) {
+            int parent = frames.empty() ? 0 : frames.back().node;
+            auto& children = call_nodes[parent].children;
+            auto it = find_if(children.begin(), children.end(),
+                              [&](int child) { return call_nodes[child].generator == generator; });
+            if (it != children.end()) {
+                node = *it;
+            } else {
+                node = (int)call_nodes.size();
+                call_nodes.push_back({generator, parent});
+                call_nodes[parent].children.push_back(node);
+            }
+            ++generators[generator].active;
+        }
+        frames.push_back({node, profile_clock::now(), 0, output_size});
+    }
+    void leave(size_t output_size) {
+        assert(!frames.empty());
+        auto frame = frames.back();
+        frames.pop_back();
+
+        auto elapsed = profile_elapsed_ns(frame.start);
+        auto self = elapsed - frame.nested_ns;
+        auto& node = call_nodes[frame.node];
+        node.self_ns += self;
+        if (!frames.empty()) frames.back().nested_ns += elapsed;
+
+        if (!node.generator) {
+            toplevel_ns += elapsed;
+            return;
+        }
+        auto& entry = generators[node.generator];
+        ++entry.count;
+        entry.self_ns += self;
+        if (--entry.active == 0) {
+            entry.total_ns += elapsed;
+            entry.bytes += (int64_t)(output_size - frame.output_size);
+        }
+    }
+};
+
+// Records a generator call, or the toplevel statements if generator is null, for the lifetime of the scope.
+struct profile_call_scope_t {
+    process_state_t* state;
+
+    profile_call_scope_t(process_state_t* state, const generator_t* generator)
+        : state(state->profiler ? state : nullptr) {
+        if (this->state) state->profiler->enter(generator, state->output_size());
+    }
+    ~profile_call_scope_t() {
+        if (state) state->profiler->leave(state->output_size());
+    }
+    profile_call_scope_t(const profile_call_scope_t&) = delete;
+    profile_call_scope_t& operator=(const profile_call_scope_t&) = delete;
+};
+
+struct profile_builtin_scope_t {
+    profile_entry_t* entry;
+    profile_clock::time_point start = profile_clock::now();
+
+    ~profile_builtin_scope_t() {
+        ++entry->count;
+        entry->total_ns += profile_elapsed_ns(start);
+    }
+};
+
+void profile_iteration(process_state_t* state, const for_t* statement) {
+    if (state->profiler) ++state->profiler->for_statements[statement].count;
+}
+
+// Methods are printed with the name of their type.
+std::string profile_builtin_name(const builtin_state_t& builtin, const builtin_function_t* function) {
+    auto find_method = [function](const builtin_type_t& type) {
+        return function >= type.methods.data() && function < type.methods.data() + type.methods.size();
+    };
+    const builtin_type_t* owner = nullptr;
+    if (find_method(builtin.array_type)) {
+        owner = &builtin.array_type;
+    } else if (find_method(builtin.string_type)) {
+        owner = &builtin.string_type;
+    } else {
+        for (auto& type : builtin.custom_types) {
+            if (find_method(type)) owner = &type;
+        }
+    }
+    std::string result;
+    if (owner) {
+        result.assign(owner->name.data(), owner->name.size());
+        result += '.';
+    }
+    result.append(function->name.data(), function->name.size());
+    return result;
+}
+
+double profile_ms(int64_t ns) { return (double)ns / 1000000.0; }
+
+void profile_print_report(FILE* stream, const process_state_t& state) {
+    assert(state.profiler);
+    auto& profiler = *state.profiler;
+
+    struct row_t {
+        std::string name;
+        const profile_entry_t* entry;
+    };
+    auto print_rows = [stream](const char* title, vector<row_t>& rows, bool generators) {
+        if (rows.empty()) return;
+        int width = (int)strlen(title);
+        for (auto& row : rows) {
+            width = max(width, (int)row.name.size());
+        }
+        if (generators) {
+            std::sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.entry->self_ns > b.entry->self_ns; });
+            tmu_fprintf(stream, "\n%-*s %10s %12s %12s %12s\n", width, title, "Calls", "Total ms", "Self ms", "Bytes");
+            for (auto& row : rows) {
+                auto entry = row.entry;
+                tmu_fprintf(stream, "%-*s %10lld %12.3f %12.3f %12lld\n", width, row.name.c_str(),
+                            (long long)entry->count, profile_ms(entry->total_ns), profile_ms(entry->self_ns),
+                            (long long)entry->bytes);
+            }
+        } else {
+            std::sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.entry->total_ns > b.entry->total_ns; });
+            tmu_fprintf(stream, "\n%-*s %10s %12s\n", width, title, "Calls", "Total ms");
+            for (auto& row : rows) {
+                tmu_fprintf(stream, "%-*s %10lld %12.3f\n", width, row.name.c_str(), (long long)row.entry->count,
+                            profile_ms(row.entry->total_ns));
+            }
+        }
+    };
+
+    tmu_fprintf(stream, "Profile: %.3f ms in toplevel statements.\n", profile_ms(profiler.toplevel_ns));
+
+    vector<row_t> rows;
+    for (auto& [generator, entry] : profiler.generators) {
+        rows.push_back({std::string(generator->name.contents.data(), generator->name.contents.size()), &entry});
+    }
+    print_rows("Generator", rows, true);
+
+    rows.clear();
+    for (auto& [function, entry] : profiler.builtins) {
+        rows.push_back({profile_builtin_name(state.builtin, function), &entry});
+    }
+    print_rows("Builtin", rows, false);
+
+    // For statements are identified by the location of their container expression.
+    vector<std::pair<std::string, int64_t>> loops;
+    for (auto& [statement, entry] : profiler.for_statements) {
+        auto location = statement->container_expression->location;
+        auto& filename = state.data->source_files[location.file_index].filename;
+        std::string name(filename.data(), filename.size());
+        name += "(" + std::to_string(location.line + 1) + ":" + std::to_string(location.column + 1) + ")";
+        loops.emplace_back(move(name), entry.count);
+    }
+    if (!loops.empty()) {
+        std::sort(loops.begin(), loops.end(), [](auto& a, auto& b) { return a.second > b.second; });
+        int width = (int)strlen("For statement");
+        for (auto& loop : loops) {
+            width = max(width, (int)loop.first.size());
+        }
+        tmu_fprintf(stream, "\n%-*s %12s\n", width, "For statement", "Iterations");
+        for (auto& loop : loops) {
+            tmu_fprintf(stream, "%-*s %12lld\n", width, loop.first.c_str(), (long long)loop.second);
+        }
+    }
+}
+
+// One line per generator call chain with the self time in microseconds, like "toplevel;outer;inner 1234".
+bool profile_write_collapsed_stacks(const char* app, const char* filename, const profiler_t& profiler) {
+    errno = 0;
+    FILE* file = tmu_fopen(filename, "wb");
+    if (!file) {
+        print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to open", filename, std::strerror(errno));
+        return false;
+    }
+
+    std::string line;
+    vector<const generator_t*> chain;
+    for (auto& node : profiler.call_nodes) {
+        auto self_us = node.self_ns / 1000;
+        if (self_us <= 0) continue;
+
+        chain.clear();
+        for (auto cur = &node; cur->generator; cur = &profiler.call_nodes[cur->parent]) {
+            chain.push_back(cur->generator);
+        }
+        line = "toplevel";
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            line += ';';
+            line.append((*it)->name.contents.data(), (*it)->name.contents.size());
+        }
+        tmu_fprintf(file, "%s %lld\n", line.c_str(), (long long)self_us);
+    }
+
+    bool write_error = ferror(file) != 0;
+    if (fclose(file) != 0 || write_error) {
+        print(stderr, "{} {}: \"{}\": {}.\n", app, "Failed to write", filename, std::strerror(errno ? errno : EIO));
+        return false;
+    }
+    return true;
+}
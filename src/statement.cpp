@@ -9,9 +9,11 @@ struct literal_block_t {
 
 struct for_t {
     string_view variable;
+    int variable_id = -1;  // Interned variable, see identifier_table.h.
     unique_expression_t container_expression;
     literal_block_t body;
     int scope_index;
+    bool mutable_elements = false;  // Loop variable is written to, which modifies the entries of the container.
 };
 
 struct if_t {
@@ -22,6 +24,13 @@ struct if_t {
     int else_scope_index = -1;
 };
 
+// Output of body goes to the file named by path_expression instead of the current output.
+struct output_t {
+    unique_expression_t path_expression;
+    literal_block_t body;
+    int scope_index = -1;
+};
+
 struct stmt_comma_t {
     int index;
     bool space_after;
@@ -54,6 +63,7 @@ enum statement_type_enum {
     stmt_break,
     stmt_continue,
     stmt_return,
+    stmt_output,
 };
 struct statement_t {
     statement_type_enum type = stmt_none;
@@ -63,6 +73,7 @@ struct statement_t {
         string literal;
         if_t if_statement;
         for_t for_statement;
+        output_t output_statement;
         stmt_comma_t comma;
         formatted_expression_t formatted;
         stmt_declaration_t declaration;
@@ -98,6 +109,10 @@ struct statement_t {
                         for_statement = move(other.for_statement);
                         return *this;
                     }
+                    case stmt_output: {
+                        output_statement = move(other.output_statement);
+                        return *this;
+                    }
                     case stmt_expression: {
                         formatted = move(other.formatted);
                         return *this;
@@ -150,6 +165,10 @@ struct statement_t {
                 new (&for_statement) for_t();
                 return;
             }
+            case stmt_output: {
+                new (&output_statement) output_t();
+                return;
+            }
             case stmt_expression: {
                 new (&formatted) formatted_expression_t();
                 return;
@@ -189,6 +208,10 @@ struct statement_t {
                     stmt->for_statement.~for_t();
                     return;
                 }
+                case stmt_output: {
+                    stmt->output_statement.~output_t();
+                    return;
+                }
                 case stmt_expression: {
                     stmt->formatted.~formatted_expression_t();
                     return;
@@ -236,6 +259,10 @@ struct statement_t {
                 new (&for_statement) for_t(move(other.for_statement));
                 return;
             }
+            case stmt_output: {
+                new (&output_statement) output_t(move(other.output_statement));
+                return;
+            }
             case stmt_expression: {
                 new (&formatted) formatted_expression_t(move(other.formatted));
                 return;
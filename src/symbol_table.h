@@ -5,6 +5,7 @@ struct symbol_index_t {
 
 struct symbol_entry_t {
     string_token name;
+    int name_id = -1;  // Interned name, see identifier_table.h.
     string_token match_type_definition_name;
     typeid_info type;
     union {
@@ -17,6 +18,10 @@ struct symbol_entry_t {
     // For symbols that refer to variables, whether the declaration of the symbol has been processed yet.
     // Checking for this field enables us to check whether a variable was referenced before it was declared.
     bool declaration_inferred = false;
+    // Whether the variable is assigned to or modified by a method. Writes propagate to aliased_expression, the
+    // expression a variable was declared with if it holds a reference.
+    bool written = false;
+    expression_t* aliased_expression = nullptr;
 };
 
 struct symbol_table_t {
@@ -25,4 +30,53 @@ struct symbol_table_t {
 
     symbol_table_t() = default;
     explicit symbol_table_t(int parent) : parent_symbol_table_index(parent) {}
+
+    symbol_entry_t* add(const symbol_entry_t& entry) { return add(make_monotonic_unique<symbol_entry_t>(entry)); }
+    // Adds an existing entry, which keeps its address.
+    symbol_entry_t* add(monotonic_unique<symbol_entry_t> entry) {
+        assert(entry->name_id >= 0);
+        auto added = symbols.emplace_back(move(entry)).get();
+        // Keep load factor at or below one half.
+        if (symbols.size() * 2 > index.size()) {
+            rebuild_index();
+        } else {
+            insert_into_index((int)symbols.size() - 1);
+        }
+        return added;
+    }
+
+    // Entries with the same name can be added multiple times (narrowed sum types in if statements), the first added
+    // entry is found.
+    symbol_entry_t* find(int name_id) {
+        if (name_id < 0 || index.empty()) return nullptr;
+        auto mask = index.size() - 1;
+        for (auto i = (size_t)hash_identifier_id(name_id) & mask;; i = (i + 1) & mask) {
+            auto symbol_index = index[i];
+            if (symbol_index < 0) return nullptr;
+            if (symbols[symbol_index]->name_id == name_id) return symbols[symbol_index].get();
+        }
+    }
+    const symbol_entry_t* find(int name_id) const { return const_cast<symbol_table_t*>(this)->find(name_id); }
+
+   private:
+    vector<int> index;  // Open addressing with linear probing into symbols, keyed by name_id. -1 means empty.
+
+    static uint32_t hash_identifier_id(int name_id) { return (uint32_t)name_id * 2654435761u; }
+
+    void insert_into_index(int symbol_index) {
+        auto name_id = symbols[symbol_index]->name_id;
+        auto mask = index.size() - 1;
+        auto i = (size_t)hash_identifier_id(name_id) & mask;
+        while (index[i] >= 0) {
+            if (symbols[index[i]]->name_id == name_id) return;
+            i = (i + 1) & mask;
+        }
+        index[i] = symbol_index;
+    }
+    void rebuild_index() {
+        index.assign(max<size_t>(index.size() * 2, 8), -1);
+        for (int i = 0, count = (int)symbols.size(); i < count; ++i) {
+            insert_into_index(i);
+        }
+    }
 };
\ No newline at end of file
@@ -157,6 +157,7 @@ token_t next_token(tokenizer_t* tokenizer) {
                 } while (is_identifier_char(*next));
                 result.type = tok_identifier;
                 result.contents = {tokenizer->current, next};
+                result.identifier_id = intern_identifier(result.contents);
                 advance_column(tokenizer, next);
             } else if (isdigit((uint8_t)*next)) {
                 // constant
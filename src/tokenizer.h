@@ -64,6 +64,7 @@ struct token_t {
     token_type_enum type;
     stream_loc_t location;
     string_view contents;
+    int identifier_id = -1;  // Interned contents if type is tok_identifier, see identifier_table.h.
 
     int contents_size() const { return (int)contents.size(); }
 };
@@ -80,10 +81,12 @@ struct stream_loc_ex_t : stream_loc_t {
 struct string_token {
     string_view contents = {};
     stream_loc_t location = {};
+    int identifier_id = -1;
 
     string_token() = default;
     // Implicit conversion from token.
-    string_token(token_t token) : contents(token.contents), location(token.location) {}
+    string_token(token_t token)
+        : contents(token.contents), location(token.location), identifier_id(token.identifier_id) {}
     string_token(string_view contents, stream_loc_t location) : contents(contents), location(location) {}
 };
 